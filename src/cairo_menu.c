@@ -6,7 +6,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 
 #ifdef MENU_DEBUG
 #define LOG_PREFIX "[CAIRO_MENU]"
@@ -19,6 +18,41 @@ static void cairo_menu_update(Menu *menu, void *user_data);
 /* static bool cairo_menu_handle_expose(Menu *menu, void *user_data); */
 static xcb_visualtype_t *get_root_visual_type(xcb_screen_t *screen);
 
+/* Window, surfaces and animations of one menu; data->menu is not set */
+static CairoMenuData *cairo_menu_data_create(xcb_connection_t *conn,
+                                             xcb_window_t parent,
+                                             X11FocusContext *ctx,
+                                             xcb_screen_t *screen) {
+    CairoMenuData *data = calloc(1, sizeof(CairoMenuData));
+    if (!data) {
+        fprintf(stderr, "Failed to allocate CairoMenuData\n");
+        return NULL;
+    }
+
+    /* Get visual type for Cairo */
+    xcb_visualtype_t *visual = get_root_visual_type(screen);
+    if (!visual) {
+        fprintf(stderr, "Failed to get visual type\n");
+        free(data);
+        return NULL;
+    }
+
+    /* Initialize rendering */
+    if (!cairo_menu_render_init(data, conn, screen, parent, ctx, visual)) {
+        fprintf(stderr, "Failed to initialize rendering\n");
+        free(data);
+        return NULL;
+    }
+    data->conn = conn;
+
+    /* Initialize animations */
+    cairo_menu_animation_init(data);
+    cairo_menu_animation_set_default(data, MENU_ANIM_FADE, MENU_ANIM_FADE,
+                                     200.0);
+    cairo_menu_animation_set_sequence(data, true, NULL);
+    return data;
+}
+
 /* Create Cairo-rendered menu */
 void menu_setup_cairo(xcb_connection_t *conn, xcb_window_t parent,
                       X11FocusContext *ctx, xcb_screen_t *screen, Menu *menu) {
@@ -39,47 +73,16 @@ void menu_setup_cairo(xcb_connection_t *conn, xcb_window_t parent,
         return;
     }
 
-    /* Create Cairo data */
-    CairoMenuData *data = calloc(1, sizeof(CairoMenuData));
-    if (!data) {
-        fprintf(stderr, "Failed to allocate CairoMenuData\n");
-        menu_destroy(menu);
-        return;
-    }
-    LOG("[%s] CairoMenuData allocated successfully\n", config->title);
-
-    /* Get visual type for Cairo */
-    LOG("[%s] Getting visual type for Cairo\n", config->title);
-    xcb_visualtype_t *visual = get_root_visual_type(screen);
-    if (!visual) {
-        fprintf(stderr, "Failed to get visual type\n");
-        free(data);
-        menu_destroy(menu);
-        return;
-    }
-    LOG("[%s] Visual type retrieved successfully\n", config->title);
-
-    /* Initialize rendering */
+    /* Create Cairo data: window, surfaces, animations */
     printf("Initializing rendering\n");
-    if (!cairo_menu_render_init(data, conn, screen, parent, ctx, visual)) {
-        fprintf(stderr, "Failed to initialize rendering\n");
-        free(data);
+    CairoMenuData *data = cairo_menu_data_create(conn, parent, ctx, screen);
+    if (!data) {
         menu_destroy(menu);
         return;
     }
-    data->conn = conn;
     /* data->render.window = parent; */
     data->menu = menu;
     LOG("[%s] Rendering initialized successfully\n", config->title);
-
-    /* Initialize animations */
-    // printf("Initializing animations\n");
-    cairo_menu_animation_init(data);
-    /* LOG("Animations initialized successfully\n"); */
-    cairo_menu_animation_set_default(data, MENU_ANIM_FADE, MENU_ANIM_FADE,
-                                     200.0);
-
-    cairo_menu_animation_set_sequence(data, true, NULL);
     /* data->anim.show_animation = menu_animation_fade_in(200); /\* 200ms fade
      * in
      */
@@ -109,6 +112,140 @@ void menu_setup_cairo(xcb_connection_t *conn, xcb_window_t parent,
 
 bool menu_cairo_is_setup(Menu *menu) { return menu && menu->user_data; }
 
+/*--------------------*/
+/* Render target pool */
+/*--------------------*/
+
+/* A menu's cleanup_cb while it holds a pooled target: the target goes back
+ * to the pool instead of being destroyed */
+static void cairo_menu_pool_release(void *user_data) {
+    CairoMenuData *data = user_data;
+    if (data)
+        data->menu = NULL;
+}
+
+/* Off-screen context with the targets' font options: measures a menu
+ * without replacing the layout a target has cached for the menu it shows */
+static CairoMenuData *cairo_menu_measure_create(const CairoMenuData *target) {
+    CairoMenuData *data = calloc(1, sizeof(CairoMenuData));
+    if (!data)
+        return NULL;
+    data->render.surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    data->render.cr = cairo_create(data->render.surface);
+    data->render.font_options =
+        cairo_font_options_copy(target->render.font_options);
+    return data;
+}
+
+CairoMenuPool *cairo_menu_pool_create(xcb_connection_t *conn,
+                                      xcb_window_t parent,
+                                      X11FocusContext *ctx,
+                                      xcb_screen_t *screen) {
+    if (!conn || !screen)
+        return NULL;
+    CairoMenuPool *pool = calloc(1, sizeof(CairoMenuPool));
+    if (!pool)
+        return NULL;
+    // Window creation, atom lookups and surface setup all happen here, at
+    // startup, rather than on a menu's first key press
+    while (pool->count < CAIRO_MENU_POOL_SIZE) {
+        CairoMenuData *data = cairo_menu_data_create(conn, parent, ctx, screen);
+        if (!data)
+            break;
+        pool->slots[pool->count++] = data;
+    }
+    if (pool->count == 0) {
+        free(pool);
+        return NULL;
+    }
+    pool->measure = cairo_menu_measure_create(pool->slots[0]);
+    LOG("Created %zu pooled render targets", pool->count);
+    return pool;
+}
+
+void cairo_menu_pool_reserve(CairoMenuPool *pool, Menu *menu) {
+    if (!pool || !pool->measure || !menu)
+        return;
+    int width = 0, height = 0;
+    cairo_menu_render_calculate_size(pool->measure, menu, &width, &height);
+    if (width <= pool->reserve_width && height <= pool->reserve_height)
+        return;
+    if (width > pool->reserve_width)
+        pool->reserve_width = width;
+    if (height > pool->reserve_height)
+        pool->reserve_height = height;
+    // Back buffers keep their storage when shrunk, so allocating for the
+    // largest menu once covers every later show
+    for (size_t i = 0; i < pool->count; i++) {
+        CairoMenuData *data = pool->slots[i];
+        if (data->menu && data->menu->active)
+            continue;
+        cairo_menu_render_resize(data, pool->reserve_width,
+                                 pool->reserve_height);
+    }
+}
+
+bool cairo_menu_pool_attach(CairoMenuPool *pool, Menu *menu) {
+    if (!pool || !menu)
+        return false;
+    if (menu->user_data)
+        return true;
+
+    /* A free target, or else the least recently used one of a hidden menu */
+    CairoMenuData *data = NULL;
+    size_t slot = 0;
+    for (size_t i = 0; i < pool->count; i++) {
+        CairoMenuData *candidate = pool->slots[i];
+        if (candidate->menu && candidate->menu->active)
+            continue;
+        if (!data || !candidate->menu ||
+            (data->menu && pool->last_use[i] < pool->last_use[slot])) {
+            data = candidate;
+            slot = i;
+        }
+        if (!candidate->menu)
+            break;
+    }
+    if (!data)
+        return false;
+
+    if (data->menu) {
+        Menu *previous = data->menu;
+        LOG("[%s] Hands its render target to [%s]", previous->config.title,
+            menu->config.title);
+        previous->user_data = NULL;
+        previous->cleanup_cb = NULL;
+        previous->update_cb = NULL;
+    }
+    data->menu = menu;
+    menu->user_data = data;
+    menu->cleanup_cb = cairo_menu_pool_release;
+    menu->update_cb = cairo_menu_update;
+    pool->last_use[slot] = ++pool->clock;
+    cairo_menu_render_request_update(data);
+    return true;
+}
+
+void cairo_menu_pool_destroy(CairoMenuPool *pool) {
+    if (!pool)
+        return;
+    for (size_t i = 0; i < pool->count; i++) {
+        CairoMenuData *data = pool->slots[i];
+        if (data->menu) {
+            data->menu->user_data = NULL;
+            data->menu->cleanup_cb = NULL;
+            data->menu->update_cb = NULL;
+        }
+        cairo_menu_cleanup(data);
+    }
+    if (pool->measure) {
+        cairo_menu_render_cleanup(pool->measure);
+        free(pool->measure);
+    }
+    free(pool);
+}
+
 /* Cleanup resources */
 // Keep original name and static linkage, matches cleanup_cb signature
 static void cairo_menu_cleanup(void *user_data) {
@@ -129,25 +266,8 @@ static void cairo_menu_update(Menu *menu, void *user_data) {
         return;
     }
 
-    /* Handle animation updates */
-    struct timeval now;
-    gettimeofday(&now, NULL);
-
-    double delta = (now.tv_sec - data->anim.last_frame.tv_sec) * 1000.0 +
-                   (now.tv_usec - data->anim.last_frame.tv_usec) / 1000.0;
-    // printf("Delta time: %f\n", delta);
-
-    cairo_menu_animation_update(data, menu, delta);
-    data->anim.last_frame = now;
-
-    if (cairo_menu_render_needs_update(data)) {
-        // printf("Rendering menu\n");
-        cairo_menu_render_begin(data);
-        cairo_menu_render_clear(data, &menu->config.style);
-        cairo_menu_render_title(data, menu->config.title, &menu->config.style);
-        cairo_menu_render_items(data, menu);
-        cairo_menu_render_end(data);
-    }
+    /* Animations are advanced by the shared frame clock */
+    cairo_menu_render_repaint(data);
 }
 
 /* Handle expose event */
@@ -270,8 +390,13 @@ void cairo_menu_destroy(Menu *menu) {
     if (menu_cairo_is_setup(menu)) {
         LOG("Calling internal cairo_menu_cleanup for menu: %s",
             menu->config.title ? menu->config.title : "(untitled)");
-        cairo_menu_cleanup(menu->user_data);
+        // Pooled targets are only handed back, not destroyed
+        if (menu->cleanup_cb)
+            menu->cleanup_cb(menu->user_data);
+        else
+            cairo_menu_cleanup(menu->user_data);
         menu->user_data = NULL; // Prevent double free by menu_destroy
+        menu->cleanup_cb = NULL;
     } else {
         LOG("cairo_menu_destroy called, but menu doesn't appear to have Cairo "
             "setup (user_data might be wrong type or NULL)");
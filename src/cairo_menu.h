@@ -9,6 +9,32 @@
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
 
+/* Menu windows and surfaces created at startup and handed to menus when
+ * they are first activated. Only one menu is visible at a time, so a
+ * couple of render targets serve every registered menu. */
+#define CAIRO_MENU_POOL_SIZE 2
+
+typedef struct CairoMenuPool {
+    struct CairoMenuData *slots[CAIRO_MENU_POOL_SIZE];
+    struct CairoMenuData *measure; /* Image context for reserve's sizes */
+    unsigned long last_use[CAIRO_MENU_POOL_SIZE]; /* For reuse */
+    unsigned long clock;
+    size_t count;       /* Slots created */
+    int reserve_width;  /* Largest registered menu */
+    int reserve_height;
+} CairoMenuPool;
+
+CairoMenuPool *cairo_menu_pool_create(xcb_connection_t *conn,
+                                      xcb_window_t parent,
+                                      X11FocusContext *ctx,
+                                      xcb_screen_t *screen);
+/* Grows the targets to fit menu, so showing it needs no new buffers */
+void cairo_menu_pool_reserve(CairoMenuPool *pool, Menu *menu);
+/* Binds a target to menu (taking the least recently used one from an
+ * inactive menu if needed); false if none is available */
+bool cairo_menu_pool_attach(CairoMenuPool *pool, Menu *menu);
+void cairo_menu_pool_destroy(CairoMenuPool *pool);
+
 bool menu_cairo_is_setup(Menu *menu);
 void menu_setup_cairo(xcb_connection_t *conn, xcb_window_t root,
                       X11FocusContext *ctx, xcb_screen_t *screen, Menu *menu);
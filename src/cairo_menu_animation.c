@@ -1,7 +1,7 @@
 #include "cairo_menu_animation.h"
+#include "frame_clock.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
 
 #ifdef MENU_DEBUG
 #define LOG_PREFIX "[CAIRO_MENU_ANIMATION]"
@@ -28,12 +28,12 @@ void cairo_menu_animation_init(CairoMenuData *data) {
                                   cairo_menu_animation_on_hide_complete, data);
   }
 
-  gettimeofday(&data->anim.last_frame, NULL);
   data->anim.is_animating = false;
 }
 
 /* Cleanup animation data */
 void cairo_menu_animation_cleanup(CairoMenuData *data) {
+  frame_clock_remove(frame_clock_shared(), data);
   if (data->anim.show_animation) {
     LOG("Cleaning up show animation: %p\n", (void *)data->anim.show_animation);
     menu_animation_destroy(data->anim.show_animation);
@@ -79,6 +79,7 @@ void cairo_menu_animation_update(CairoMenuData *data, Menu *menu,
 /* Apply animation transforms */
 void cairo_menu_animation_apply(CairoMenuData *data, Menu *menu, cairo_t *cr) {
   MenuAnimation *anim = NULL;
+  (void)cr; // Composed by the renderer, see set_opacity/set_transform
 
   if (data->anim.is_animating) {
     if (menu->state == MENU_STATE_INITIALIZING) {
@@ -88,20 +89,44 @@ void cairo_menu_animation_apply(CairoMenuData *data, Menu *menu, cairo_t *cr) {
     }
   }
 
+  // Only the properties an animation type sets are meaningful: a fade
+  // leaves scale at 0, a slide leaves opacity at 0
+  double opacity = 1.0, x = 0, y = 0, scale = 1.0;
   if (anim) {
-    /* Apply transforms */
-    double x, y;
-    menu_animation_get_position(anim, &x, &y);
-    cairo_translate(cr, x, y);
-
-    double scale = menu_animation_get_scale(anim);
-    cairo_scale(cr, scale, scale);
-
-    double opacity = menu_animation_get_opacity(anim);
-    cairo_push_group(cr);
-    cairo_pop_group_to_source(cr);
-    cairo_paint_with_alpha(cr, opacity);
+    switch (anim->type) {
+    case MENU_ANIM_ZOOM:
+      scale = menu_animation_get_scale(anim);
+      opacity = menu_animation_get_opacity(anim);
+      break;
+    case MENU_ANIM_FADE:
+      opacity = menu_animation_get_opacity(anim);
+      break;
+    case MENU_ANIM_SLIDE_RIGHT:
+    case MENU_ANIM_SLIDE_LEFT:
+    case MENU_ANIM_SLIDE_UP:
+    case MENU_ANIM_SLIDE_DOWN:
+      menu_animation_get_position(anim, &x, &y);
+      break;
+    default:
+      break;
+    }
   }
+  // Back to the plain frame once the animation is done
+  cairo_menu_render_set_opacity(data, opacity);
+  cairo_menu_render_set_transform(data, x, y, scale);
+}
+
+/* One frame clock tick: advance by the fixed frame delta and paint */
+static bool cairo_menu_animation_frame(void *user_data, double delta_ms) {
+  CairoMenuData *data = user_data;
+  if (!data->menu)
+    return false;
+  cairo_menu_animation_update(data, data->menu, delta_ms);
+  cairo_menu_animation_apply(data, data->menu, data->render.cr);
+  // A hiding menu is unmapped as soon as the hide starts
+  if (data->menu->state != MENU_STATE_INACTIVE)
+    cairo_menu_render_repaint(data);
+  return data->anim.is_animating;
 }
 
 /* Trigger show animation */
@@ -110,6 +135,9 @@ void cairo_menu_animation_show(CairoMenuData *data, Menu *menu) {
   data->anim.is_animating = true;
   menu->state = MENU_STATE_INITIALIZING;
   menu_animation_start(data->anim.show_animation);
+  // The first frame already shows the start of the animation
+  cairo_menu_animation_apply(data, menu, data->render.cr);
+  frame_clock_add(frame_clock_shared(), cairo_menu_animation_frame, data);
 }
 
 /* Trigger hide animation */
@@ -118,6 +146,8 @@ void cairo_menu_animation_hide(CairoMenuData *data, Menu *menu) {
   data->anim.is_animating = true;
   menu->state = MENU_STATE_INACTIVE;
   menu_animation_start(data->anim.hide_animation);
+  cairo_menu_animation_apply(data, menu, data->render.cr);
+  frame_clock_add(frame_clock_shared(), cairo_menu_animation_frame, data);
 }
 
 /* Set default animations */
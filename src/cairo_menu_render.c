@@ -1,21 +1,32 @@
 #include "cairo_menu_render.h"
+#include "x11_stats.h"
 #include "x11_window.h"
 #include <cairo/cairo-xcb.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #ifdef MENU_DEBUG
 #define LOG_PREFIX "[CAIRO_MENU_RENDER]"
 #endif
 #include "log.h"
+
+/* Windows starting right of this x are on the second monitor */
+#define CAIRO_MENU_MONITOR_SPLIT_X 1900
+
+static int monitor_index(int x) {
+  return x > CAIRO_MENU_MONITOR_SPLIT_X ? 1 : 0;
+}
+
 int get_window_absolute_geometry(xcb_connection_t *conn, xcb_window_t window) {
   int x = 0, y = 0, width = 0, height = 0;
 
   // Request the window's geometry (x, y, width, height) relative to its parent.
   xcb_get_geometry_cookie_t geo_cookie = xcb_get_geometry(conn, window);
   xcb_get_geometry_reply_t *geo_reply =
-      xcb_get_geometry_reply(conn, geo_cookie, NULL);
+      X11_SYNC(xcb_get_geometry_reply(conn, geo_cookie, NULL));
   /* if (!geo_reply) { */
   /*   // If reply is NULL, the geometry couldn't be retrieved; return default
    */
@@ -40,7 +51,7 @@ int get_window_absolute_geometry(xcb_connection_t *conn, xcb_window_t window) {
   xcb_translate_coordinates_cookie_t tcookie =
       xcb_translate_coordinates(conn, window, geo_reply->root, 0, 0);
   xcb_translate_coordinates_reply_t *treply =
-      xcb_translate_coordinates_reply(conn, tcookie, NULL);
+      X11_SYNC(xcb_translate_coordinates_reply(conn, tcookie, NULL));
   if (treply) {
     x = treply->dst_x; // Absolute x position relative to the root window.
     y = treply->dst_y; // Absolute y position relative to the root window.
@@ -53,7 +64,7 @@ int get_window_absolute_geometry(xcb_connection_t *conn, xcb_window_t window) {
 
   // Set the width and height as reported by the geometry reply.
   free(geo_reply);
-  return x > 1900 ? 1 : 0;
+  return monitor_index(x);
 }
 
 /* static int get_desktop_x(xcb_connection_t *conn) { */
@@ -78,7 +89,13 @@ int get_window_absolute_geometry(xcb_connection_t *conn, xcb_window_t window) {
 /*   free(reply); */
 /*   return desktop_x; */
 /* } */
-static int get_active_window_top_right_corner(xcb_connection_t *conn) {
+static int get_active_window_top_right_corner(xcb_connection_t *conn,
+                                              X11FocusContext *ctx) {
+  // Tracked from events: no round-trip
+  int cached_x;
+  if (x11_focus_active_geometry(ctx, &cached_x, NULL, NULL, NULL))
+    return cached_x;
+
   // Get the active window ID
   xcb_window_t active_window = window_get_focused(conn);
   if (active_window == XCB_NONE) {
@@ -87,7 +104,8 @@ static int get_active_window_top_right_corner(xcb_connection_t *conn) {
 
   // Get the geometry of the active window
   xcb_get_geometry_cookie_t cookie = xcb_get_geometry(conn, active_window);
-  xcb_get_geometry_reply_t *reply = xcb_get_geometry_reply(conn, cookie, NULL);
+  xcb_get_geometry_reply_t *reply =
+      X11_SYNC(xcb_get_geometry_reply(conn, cookie, NULL));
   if (!reply) {
     return -1;
   }
@@ -108,27 +126,20 @@ static int get_active_window_top_right_corner(xcb_connection_t *conn) {
 */
 // Function to set the window sticky by changing _NET_WM_STATE property.
 // This makes the window appear on all desktops.
-static void set_window_sticky(xcb_connection_t *conn, xcb_window_t window) {
-  // Get _NET_WM_STATE atom.
-  xcb_intern_atom_cookie_t cookie_state =
-      xcb_intern_atom(conn, 0, strlen("_NET_WM_STATE"), "_NET_WM_STATE");
-  xcb_intern_atom_reply_t *reply_state =
-      xcb_intern_atom_reply(conn, cookie_state, NULL);
-
-  // Get _NET_WM_STATE_STICKY atom.
-  xcb_intern_atom_cookie_t cookie_sticky = xcb_intern_atom(
-      conn, 0, strlen("_NET_WM_STATE_STICKY"), "_NET_WM_STATE_STICKY");
-  xcb_intern_atom_reply_t *reply_sticky =
-      xcb_intern_atom_reply(conn, cookie_sticky, NULL);
-
-  if (reply_state && reply_sticky) {
+static void set_window_sticky(xcb_connection_t *conn, X11FocusContext *ctx,
+                              xcb_window_t window) {
+  // Atoms were interned with the EWMH connection at connect time.
+  if (!ctx || !ctx->ewmh)
+    return;
+  xcb_atom_t state = ctx->ewmh->_NET_WM_STATE;
+  xcb_atom_t sticky = ctx->ewmh->_NET_WM_STATE_STICKY;
+
+  if (state != XCB_NONE && sticky != XCB_NONE) {
     // Set the _NET_WM_STATE property on the window to include
     // _NET_WM_STATE_STICKY. XCB_ATOM_ATOM is used as the property type.
-    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, window, reply_state->atom,
-                        XCB_ATOM_ATOM, 32, 1, &reply_sticky->atom);
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, window, state,
+                        XCB_ATOM_ATOM, 32, 1, &sticky);
   }
-  free(reply_state);
-  free(reply_sticky);
 }
 
 /*-------------------------*/
@@ -191,13 +202,15 @@ static void draw_drop_shadow(cairo_t *cr, double x, double y, double width,
 */
 static void draw_highlight_effect(cairo_t *cr, double x, double y, double width,
                                   double height, double radius,
+                                  double gradient_height,
                                   const double highlight_color[4]) {
   cairo_save(cr);
   cairo_translate(cr, x, y);
   cairo_new_path(cr);
   draw_rounded_rectangle(cr, 0, 0, width, height, radius);
   cairo_clip(cr);
-  cairo_pattern_t *pattern = cairo_pattern_create_linear(0, 0, 0, height);
+  cairo_pattern_t *pattern =
+      cairo_pattern_create_linear(0, 0, 0, gradient_height);
   cairo_pattern_add_color_stop_rgba(
       pattern, 0, highlight_color[0] * 1.2, highlight_color[1] * 1.2,
       highlight_color[2] * 1.2, highlight_color[3]);
@@ -210,6 +223,349 @@ static void draw_highlight_effect(cairo_t *cr, double x, double y, double width,
   cairo_restore(cr);
 }
 
+/*--------------------*/
+/* Decoration sprites */
+/*--------------------*/
+
+/* Highlights and shadows are rounded boxes whose look only varies
+ * vertically, so for a given height a box of any width is its two corner
+ * columns plus one middle column repeated in between. Each kind of box is
+ * rasterised once into such a sprite (arcs, clip and gradient included)
+ * and every row is then three small blits. Width is free, so the
+ * stretchable middle row of a full nine-patch is not needed: height is
+ * part of the key instead. */
+
+static void sprite_release(CairoMenuSprite *sprite) {
+  cairo_pattern_destroy(sprite->middle);
+  cairo_surface_destroy(sprite->surface);
+  *sprite = (CairoMenuSprite){0};
+}
+
+static void sprite_cache_clear(CairoMenuRenderData *render) {
+  for (int i = 0; i < CAIRO_MENU_SPRITE_CACHE_SIZE; i++)
+    if (render->sprites[i].surface)
+      sprite_release(&render->sprites[i]);
+}
+
+static const CairoMenuSprite *sprite_get(CairoMenuRenderData *render,
+                                         bool gradient, double radius,
+                                         double height, double gradient_height,
+                                         const double color[4]) {
+  CairoMenuSprite *slot = &render->sprites[0];
+  for (int i = 0; i < CAIRO_MENU_SPRITE_CACHE_SIZE; i++) {
+    CairoMenuSprite *sprite = &render->sprites[i];
+    if (sprite->surface && sprite->gradient == gradient &&
+        sprite->radius == radius && sprite->height == height &&
+        sprite->gradient_height == gradient_height &&
+        memcmp(sprite->color, color, sizeof(sprite->color)) == 0) {
+      sprite->last_use = ++render->sprite_clock;
+      return sprite;
+    }
+    // Free slot, or else the least recently used one
+    if (slot->surface &&
+        (!sprite->surface || sprite->last_use < slot->last_use))
+      slot = sprite;
+  }
+
+  int cap = (int)ceil(radius);
+  int width = cap * 2 + 1;
+  cairo_surface_t *surface =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, (int)ceil(height));
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  cairo_t *cr = cairo_create(surface);
+  cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+  if (gradient) {
+    draw_highlight_effect(cr, 0, 0, width, height, radius, gradient_height,
+                          color);
+  } else {
+    cairo_set_source_rgba(cr, color[0], color[1], color[2], color[3]);
+    draw_rounded_rectangle(cr, 0, 0, width, height, radius);
+    cairo_fill(cr);
+  }
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+
+  cairo_surface_t *column =
+      cairo_surface_create_for_rectangle(surface, cap, 0, 1, height);
+  cairo_pattern_t *middle = cairo_pattern_create_for_surface(column);
+  cairo_surface_destroy(column); // Kept alive by the pattern
+  cairo_pattern_set_extend(middle, CAIRO_EXTEND_REPEAT);
+
+  if (slot->surface)
+    sprite_release(slot);
+  *slot = (CairoMenuSprite){.surface = surface,
+                            .middle = middle,
+                            .cap = cap,
+                            .gradient = gradient,
+                            .radius = radius,
+                            .height = height,
+                            .gradient_height = gradient_height,
+                            .color = {color[0], color[1], color[2], color[3]},
+                            .last_use = ++render->sprite_clock};
+  return slot;
+}
+
+/* Draws the sprite's box at x, y stretched to width */
+static void sprite_stamp(cairo_t *cr, const CairoMenuSprite *sprite, double x,
+                         double y, double width) {
+  int cap = sprite->cap;
+  double height = sprite->height;
+  cairo_save(cr);
+  cairo_rectangle(cr, x, y, cap, height);
+  cairo_set_source_surface(cr, sprite->surface, x, y);
+  cairo_fill(cr);
+  cairo_rectangle(cr, x + width - cap, y, cap, height);
+  cairo_set_source_surface(cr, sprite->surface, x + width - (cap * 2 + 1), y);
+  cairo_fill(cr);
+  cairo_matrix_t matrix;
+  cairo_matrix_init_translate(&matrix, -(x + cap), -y);
+  cairo_pattern_set_matrix(sprite->middle, &matrix);
+  cairo_rectangle(cr, x + cap, y, width - cap * 2, height);
+  cairo_set_source(cr, sprite->middle);
+  cairo_fill(cr);
+  cairo_restore(cr);
+}
+
+/* draw_highlight_effect, from a sprite when the box is wide enough */
+static void stamp_highlight(CairoMenuData *data, double x, double y,
+                            double width, double height, double radius,
+                            double gradient_height, const double color[4]) {
+  const CairoMenuSprite *sprite =
+      width > ceil(radius) * 2 + 1
+          ? sprite_get(&data->render, true, radius, height, gradient_height,
+                       color)
+          : NULL;
+  if (sprite)
+    sprite_stamp(data->render.cr, sprite, x, y, width);
+  else
+    draw_highlight_effect(data->render.cr, x, y, width, height, radius,
+                          gradient_height, color);
+}
+
+/* draw_drop_shadow, from a sprite when the box is wide enough */
+static void stamp_shadow(CairoMenuData *data, double x, double y,
+                         double width, double height, double radius,
+                         double shadow_offset, const double color[4]) {
+  const CairoMenuSprite *sprite =
+      width > ceil(radius) * 2 + 1
+          ? sprite_get(&data->render, false, radius, height, 0, color)
+          : NULL;
+  if (sprite)
+    sprite_stamp(data->render.cr, sprite, x + shadow_offset, y + shadow_offset,
+                 width);
+  else
+    draw_drop_shadow(data->render.cr, x, y, width, height, radius,
+                     shadow_offset, color);
+}
+
+/*------------*/
+/* Font cache */
+/*------------*/
+
+/* Resolving a font (fontconfig lookup, scaled font creation) is far more
+ * expensive than drawing a few labels, so the scaled fonts a menu uses are
+ * created once and set directly on the context afterwards. */
+
+static void font_cache_clear(CairoMenuRenderData *render) {
+  for (int i = 0; i < CAIRO_MENU_FONT_CACHE_SIZE; i++) {
+    CairoMenuFont *font = &render->fonts[i];
+    if (!font->scaled)
+      continue;
+    cairo_scaled_font_destroy(font->scaled);
+    cairo_font_options_destroy(font->options);
+    free(font->face);
+    *font = (CairoMenuFont){0};
+  }
+}
+
+static cairo_scaled_font_t *font_cache_get(CairoMenuRenderData *render,
+                                           const char *face, double size,
+                                           cairo_font_weight_t weight) {
+  if (!face)
+    face = "";
+  CairoMenuFont *slot = &render->fonts[0];
+  for (int i = 0; i < CAIRO_MENU_FONT_CACHE_SIZE; i++) {
+    CairoMenuFont *font = &render->fonts[i];
+    if (font->scaled && font->size == size && font->weight == weight &&
+        strcmp(font->face, face) == 0 &&
+        cairo_font_options_equal(font->options, render->font_options)) {
+      font->last_use = ++render->font_clock;
+      return font->scaled;
+    }
+    // Free slot, or else the least recently used one
+    if (slot->scaled && (!font->scaled || font->last_use < slot->last_use))
+      slot = font;
+  }
+
+  cairo_font_face_t *font_face =
+      cairo_toy_font_face_create(face, CAIRO_FONT_SLANT_NORMAL, weight);
+  cairo_matrix_t font_matrix, ctm;
+  cairo_matrix_init_scale(&font_matrix, size, size);
+  cairo_matrix_init_identity(&ctm);
+  cairo_scaled_font_t *scaled = cairo_scaled_font_create(
+      font_face, &font_matrix, &ctm, render->font_options);
+  cairo_font_face_destroy(font_face);
+  if (cairo_scaled_font_status(scaled) != CAIRO_STATUS_SUCCESS) {
+    cairo_scaled_font_destroy(scaled);
+    return NULL;
+  }
+
+  if (slot->scaled) {
+    cairo_scaled_font_destroy(slot->scaled);
+    cairo_font_options_destroy(slot->options);
+    free(slot->face);
+  }
+  *slot = (CairoMenuFont){.face = strdup(face),
+                          .size = size,
+                          .weight = weight,
+                          .options = cairo_font_options_copy(
+                              render->font_options),
+                          .scaled = scaled,
+                          .last_use = ++render->font_clock};
+  return scaled;
+}
+
+static void use_font(CairoMenuData *data, const char *face, double size,
+                     cairo_font_weight_t weight) {
+  cairo_t *cr = data->render.cr;
+  cairo_scaled_font_t *scaled =
+      font_cache_get(&data->render, face, size, weight);
+  if (scaled) {
+    cairo_set_scaled_font(cr, scaled);
+    return;
+  }
+  cairo_select_font_face(cr, face ? face : "", CAIRO_FONT_SLANT_NORMAL,
+                         weight);
+  cairo_set_font_size(cr, size);
+}
+
+// The title is slightly larger and bolder than the items
+static void use_title_font(CairoMenuData *data, const MenuStyle *style) {
+  use_font(data, style->font_face, style->font_size * 1.1,
+           CAIRO_FONT_WEIGHT_BOLD);
+}
+
+static void use_item_font(CairoMenuData *data, const MenuStyle *style) {
+  use_font(data, style->font_face, style->font_size, CAIRO_FONT_WEIGHT_NORMAL);
+}
+
+/*-------------*/
+/* Glyph cache */
+/*-------------*/
+
+/* cairo_show_text converts UTF-8 to glyphs and lays them out on every
+ * call. Labels rarely change between frames, so each label keeps the glyph
+ * run it produced; a run is rebuilt when the string behind the pointer or
+ * the font it is drawn with changes. */
+
+static uint32_t label_hash(const char *label) {
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (const unsigned char *p = (const unsigned char *)label; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
+}
+
+static size_t glyph_slot(const CairoMenuGlyphCache *cache, const char *label) {
+  size_t mask = cache->capacity - 1;
+  size_t i = ((uintptr_t)label >> 3) * 2654435761u & mask;
+  while (cache->runs[i].label && cache->runs[i].label != label)
+    i = (i + 1) & mask;
+  return i;
+}
+
+static void glyph_run_release(CairoMenuGlyphRun *run) {
+  cairo_glyph_free(run->glyphs);
+  cairo_scaled_font_destroy(run->font);
+  *run = (CairoMenuGlyphRun){0};
+}
+
+static void glyph_cache_clear(CairoMenuGlyphCache *cache) {
+  for (size_t i = 0; i < cache->capacity; i++)
+    if (cache->runs[i].label)
+      glyph_run_release(&cache->runs[i]);
+  free(cache->runs);
+  *cache = (CairoMenuGlyphCache){0};
+}
+
+// Keeps the table at most half full; starts over past the limit
+static bool glyph_cache_reserve(CairoMenuGlyphCache *cache) {
+  if ((cache->count + 1) * 2 <= cache->capacity)
+    return true;
+  if (cache->count + 1 > CAIRO_MENU_GLYPH_CACHE_MAX)
+    glyph_cache_clear(cache);
+
+  size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+  CairoMenuGlyphRun *runs = calloc(capacity, sizeof(*runs));
+  if (!runs)
+    return false;
+  CairoMenuGlyphCache grown = {runs, capacity, cache->count};
+  for (size_t i = 0; i < cache->capacity; i++)
+    if (cache->runs[i].label)
+      runs[glyph_slot(&grown, cache->runs[i].label)] = cache->runs[i];
+  free(cache->runs);
+  *cache = grown;
+  return true;
+}
+
+/* The run for label in the current font, converted if needed */
+static const CairoMenuGlyphRun *glyph_run_get(CairoMenuData *data,
+                                              const char *label) {
+  CairoMenuGlyphCache *cache = &data->render.glyphs;
+  cairo_scaled_font_t *font = cairo_get_scaled_font(data->render.cr);
+  uint32_t hash = label_hash(label);
+
+  CairoMenuGlyphRun *run = NULL;
+  if (cache->capacity) {
+    run = &cache->runs[glyph_slot(cache, label)];
+    if (run->label == label && run->hash == hash && run->font == font)
+      return run;
+  }
+  if (!run || !run->label) {
+    if (!glyph_cache_reserve(cache))
+      return NULL;
+    run = &cache->runs[glyph_slot(cache, label)];
+  }
+
+  cairo_glyph_t *glyphs = NULL;
+  int glyph_count = 0;
+  if (cairo_scaled_font_text_to_glyphs(font, 0, 0, label, -1, &glyphs,
+                                       &glyph_count, NULL, NULL,
+                                       NULL) != CAIRO_STATUS_SUCCESS)
+    return NULL;
+
+  if (run->label)
+    glyph_run_release(run);
+  else
+    cache->count++;
+  *run = (CairoMenuGlyphRun){.label = label,
+                             .hash = hash,
+                             .font = cairo_scaled_font_reference(font),
+                             .glyphs = glyphs,
+                             .glyph_count = glyph_count};
+  return run;
+}
+
+/* Draws label at the current point, like cairo_show_text */
+static void show_label(CairoMenuData *data, const char *label) {
+  cairo_t *cr = data->render.cr;
+  if (!label)
+    return;
+  const CairoMenuGlyphRun *run = glyph_run_get(data, label);
+  if (!run) {
+    cairo_show_text(cr, label);
+    return;
+  }
+  double x, y;
+  cairo_get_current_point(cr, &x, &y);
+  cairo_save(cr);
+  cairo_translate(cr, x, y);
+  cairo_show_glyphs(cr, run->glyphs, run->glyph_count);
+  cairo_restore(cr);
+}
+
 /*-----------------------------*/
 /* Improved Rendering Routines */
 /*-----------------------------*/
@@ -231,27 +587,22 @@ void cairo_menu_render_title(CairoMenuData *data, const char *title,
   cairo_t *cr = data->render.cr;
   cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
   // Use a bold face for the title
-  cairo_select_font_face(cr, style->font_face, CAIRO_FONT_SLANT_NORMAL,
-                         CAIRO_FONT_WEIGHT_BOLD);
-  cairo_set_font_size(cr, style->font_size * 1.1);
+  use_title_font(data, style);
   cairo_set_source_rgba(cr, style->text_color[0], style->text_color[1],
                         style->text_color[2], style->text_color[3]);
   double x = style->padding;
-  double y = style->padding + style->font_size;
+  double y = data->layout.valid ? data->layout.title_baseline
+                                : style->padding + style->font_size;
   cairo_move_to(cr, x, y);
-  cairo_show_text(cr, title);
+  show_label(data, title);
 }
 
 /* Render an individual menu item.
    For a selected item, draw a drop shadow and a gradient-filled rounded
    rectangle, then render the text in white.
 */
-void cairo_menu_render_item(CairoMenuData *data, const MenuItem *item,
-                            const MenuStyle *style, bool is_selected,
-                            double y_position) {
-  cairo_t *cr = data->render.cr;
-  cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
-
+static void render_item_nuance(CairoMenuData *data, const MenuStyle *style,
+                               double y_position) {
   double item_width = data->render.width - style->padding * 2;
   double x = style->padding;
   double radius = 6.0; // Rounded corner radius for modern UI
@@ -259,39 +610,35 @@ void cairo_menu_render_item(CairoMenuData *data, const MenuItem *item,
   // add nuance to the selected item
   double nuance_intensity = 0.2;
   double nuance_color[4] = {0.3, 0.3, 0.3, 0.1}; // Semi-transparent black
-  draw_highlight_effect(cr, x, y_position, item_width,
-                        style->item_height - style->padding, radius,
-                        nuance_color);
-  cairo_menu_render_set_opacity(data, 0.1);
+  double height = style->item_height - style->padding;
+  stamp_highlight(data, x, y_position, item_width, height, radius, height,
+                  nuance_color);
+}
+
+/* Everything of an item that is drawn over its nuance box */
+static void render_item_foreground(CairoMenuData *data, const MenuItem *item,
+                                   const MenuStyle *style, bool is_selected,
+                                   double y_position) {
+  cairo_t *cr = data->render.cr;
+  cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+
+  double item_width = data->render.width - style->padding * 2;
+  double x = style->padding;
+  double radius = 6.0; // Rounded corner radius for modern UI
+
   if (is_selected) {
     // Draw a subtle drop shadow to give depth
     double shadow_offset = 3.0;
     double shadow_color[4] = {0, 0, 0, 0.4}; // Semi-transparent black
-    draw_drop_shadow(cr, x, y_position, item_width,
-                     style->item_height - style->padding, radius, shadow_offset,
-                     shadow_color);
+    stamp_shadow(data, x, y_position, item_width,
+                 style->item_height - style->padding, radius, shadow_offset,
+                 shadow_color);
 
     // Draw the selected background with a gradient inside a rounded
     // rectangle
-    cairo_save(cr);
-    cairo_translate(cr, x, y_position);
-    cairo_new_path(cr);
-    draw_rounded_rectangle(cr, 0, 0, item_width,
-                           style->item_height - style->padding, radius);
-    cairo_clip(cr);
-    cairo_pattern_t *pattern =
-        cairo_pattern_create_linear(0, 0, 0, style->item_height);
-    cairo_pattern_add_color_stop_rgba(
-        pattern, 0, style->highlight_color[0] * 1.2,
-        style->highlight_color[1] * 1.2, style->highlight_color[2] * 1.2,
-        style->highlight_color[3]);
-    cairo_pattern_add_color_stop_rgba(
-        pattern, 1, style->highlight_color[0], style->highlight_color[1],
-        style->highlight_color[2], style->highlight_color[3]);
-    cairo_set_source(cr, pattern);
-    cairo_paint(cr);
-    cairo_pattern_destroy(pattern);
-    cairo_restore(cr);
+    stamp_highlight(data, x, y_position, item_width,
+                    style->item_height - style->padding, radius,
+                    style->item_height, style->highlight_color);
 
     // Render the text in white to improve contrast on the highlighted
     // background.
@@ -301,9 +648,19 @@ void cairo_menu_render_item(CairoMenuData *data, const MenuItem *item,
                           style->text_color[2], style->text_color[3]);
   }
 
-  cairo_move_to(cr, x + style->padding,
-                y_position + style->padding + style->font_size);
-  cairo_show_text(cr, item->label);
+  use_item_font(data, style);
+  double baseline = data->layout.valid ? data->layout.item_baseline
+                                       : style->padding + style->font_size;
+  cairo_move_to(cr, x + style->padding, y_position + baseline);
+  show_label(data, item->label);
+}
+
+void cairo_menu_render_item(CairoMenuData *data, const MenuItem *item,
+                            const MenuStyle *style, bool is_selected,
+                            double y_position) {
+  cairo_set_antialias(data->render.cr, CAIRO_ANTIALIAS_BEST);
+  render_item_nuance(data, style, y_position);
+  render_item_foreground(data, item, style, is_selected, y_position);
 }
 
 /*-------------------------*/
@@ -410,7 +767,7 @@ static xcb_window_t create_window(xcb_connection_t *conn, xcb_window_t parent,
 
   // Default positioning: top-right of the screen with 20px padding.
   /* int x = screen->width_in_pixels - width - 20; */
-  int x = get_active_window_top_right_corner(conn); //- width - 20;
+  int x = get_active_window_top_right_corner(conn, ctx); //- width - 20;
   int y = 30;
 
   // Generate new window ID.
@@ -430,13 +787,382 @@ static xcb_window_t create_window(xcb_connection_t *conn, xcb_window_t parent,
   // x11_set_window_floating(ctx, window);
 
   // Mark the window as sticky so that it appears on all desktops.
-  set_window_sticky(conn, window);
+  set_window_sticky(conn, ctx, window);
 
   // Debug output.
   printf("Created sticky window: %u at position (%d, %d)\n", window, x, y);
   return window;
 }
 
+/*-------------------------*/
+/* Back buffer             */
+/*-------------------------*/
+
+/* The back buffer is a CAIRO_FORMAT_RGB24 image copied to the window as a
+ * ZPixmap, so the visual must store pixels the same way: 32 bits per pixel,
+ * 8-bit channels, in host byte order. */
+static bool backbuffer_supported(xcb_connection_t *conn, xcb_screen_t *screen,
+                                 const xcb_visualtype_t *visual) {
+  if (!visual || visual->_class != XCB_VISUAL_CLASS_TRUE_COLOR ||
+      visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 ||
+      visual->blue_mask != 0xff)
+    return false;
+
+  const xcb_setup_t *setup = xcb_get_setup(conn);
+  const uint16_t probe = 1;
+  uint8_t host_order = *(const uint8_t *)&probe ? XCB_IMAGE_ORDER_LSB_FIRST
+                                                : XCB_IMAGE_ORDER_MSB_FIRST;
+  if (setup->image_byte_order != host_order)
+    return false;
+
+  xcb_format_iterator_t it = xcb_setup_pixmap_formats_iterator(setup);
+  for (; it.rem; xcb_format_next(&it)) {
+    if (it.data->depth == screen->root_depth)
+      return it.data->bits_per_pixel == 32;
+  }
+  return false;
+}
+
+// May wait for BIG-REQUESTS to be enabled; done once at init
+static uint32_t backbuffer_max_request_bytes(xcb_connection_t *conn) {
+  x11_rt_wait_begin();
+  uint32_t units = xcb_get_maximum_request_length(conn);
+  x11_rt_wait_end(NULL);
+  return units * 4;
+}
+
+// QueryExtension is cached by xcb; only the first call waits
+static bool shm_extension_present(xcb_connection_t *conn) {
+  x11_rt_wait_begin();
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(conn, &xcb_shm_id);
+  x11_rt_wait_end(NULL);
+  return ext && ext->present;
+}
+
+/* Shared segment of at least size bytes, attached on both sides. check
+ * waits for the server to confirm the attach (it fails for remote
+ * displays); later segments are attached without waiting. */
+static bool shm_segment_create(CairoMenuData *data, size_t size, bool check) {
+  CairoMenuRenderData *render = &data->render;
+  int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (id < 0)
+    return false;
+  uint8_t *addr = shmat(id, NULL, 0);
+  if (addr == (void *)-1) {
+    shmctl(id, IPC_RMID, NULL);
+    return false;
+  }
+
+  xcb_shm_seg_t seg = xcb_generate_id(data->conn);
+  bool attached = true;
+  if (check) {
+    xcb_generic_error_t *error = X11_SYNC(
+        xcb_request_check(data->conn, xcb_shm_attach_checked(data->conn, seg,
+                                                             id, 0)));
+    attached = !error;
+    free(error);
+  } else {
+    xcb_shm_attach(data->conn, seg, id, 0);
+  }
+  // Marked for removal right away: it goes once both sides detached (Linux
+  // still lets the server attach a segment marked this way)
+  shmctl(id, IPC_RMID, NULL);
+  if (!attached) {
+    shmdt(addr);
+    return false;
+  }
+
+  render->shm_seg = seg;
+  render->shm_addr = addr;
+  render->shm_size = size;
+  return true;
+}
+
+static void shm_segment_destroy(CairoMenuData *data) {
+  CairoMenuRenderData *render = &data->render;
+  if (!render->shm_addr)
+    return;
+  // Requests are processed in order: an upload still queued is done before
+  // the server detaches, and our own mapping does not affect the server's
+  if (!xcb_connection_has_error(data->conn))
+    xcb_shm_detach(data->conn, render->shm_seg);
+  shmdt(render->shm_addr);
+  render->shm_addr = NULL;
+  render->shm_size = 0;
+}
+
+/* The server reads the segment while it processes ShmPutImage and sends a
+ * ShmCompletion event once done (see cairo_menu_render_handle_event).
+ * Normally that arrives long before the next key press; only if it has not
+ * been seen yet do we block, on a round-trip the server answers after the
+ * upload. */
+static void shm_fence_wait(CairoMenuData *data) {
+  CairoMenuRenderData *render = &data->render;
+  if (!render->shm_fence_pending)
+    return;
+  render->shm_fence_pending = false;
+  free(X11_SYNC(xcb_get_input_focus_reply(
+      data->conn, xcb_get_input_focus(data->conn), NULL)));
+}
+
+bool cairo_menu_render_handle_event(CairoMenuData *data,
+                                    const xcb_generic_event_t *event) {
+  CairoMenuRenderData *render = &data->render;
+  if (!render->shm_fence_pending || !data->conn || !event)
+    return false;
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(data->conn, &xcb_shm_id);
+  if (!ext || !ext->present ||
+      (event->response_type & ~0x80) != ext->first_event + XCB_SHM_COMPLETION)
+    return false;
+  // Older completions (already waited for) are ignored by their sequence
+  const xcb_shm_completion_event_t *done =
+      (const xcb_shm_completion_event_t *)event;
+  if (done->shmseg != render->shm_seg ||
+      done->sequence != (uint16_t)render->shm_fence)
+    return false;
+  render->shm_fence_pending = false;
+  return true;
+}
+
+static void backbuffer_free(CairoMenuData *data) {
+  CairoMenuRenderData *render = &data->render;
+  if (render->cr) {
+    cairo_destroy(render->cr);
+    render->cr = NULL;
+  }
+  if (render->surface) {
+    cairo_surface_destroy(render->surface);
+    render->surface = NULL;
+  }
+}
+
+/* (Re)creates the back buffer for width x height. A shared segment is kept
+ * as long as the frame fits into it. */
+static bool backbuffer_alloc(CairoMenuData *data, int width, int height,
+                             bool check) {
+  CairoMenuRenderData *render = &data->render;
+  backbuffer_free(data);
+  render->buffer_width = width;
+  render->buffer_height = height;
+
+  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, width);
+  if (render->upload == CAIRO_MENU_UPLOAD_SHM) {
+    size_t size = (size_t)stride * (height > 0 ? height : 1);
+    if (size > render->shm_size) {
+      shm_fence_wait(data);
+      shm_segment_destroy(data);
+      if (!shm_segment_create(data, size, check))
+        return false;
+    }
+    render->surface = cairo_image_surface_create_for_data(
+        render->shm_addr, CAIRO_FORMAT_RGB24, width, height, stride);
+  } else {
+    render->surface =
+        cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  }
+  render->cr = cairo_create(render->surface);
+  return cairo_surface_status(render->surface) == CAIRO_STATUS_SUCCESS &&
+         cairo_status(render->cr) == CAIRO_STATUS_SUCCESS;
+}
+
+bool cairo_menu_render_set_upload(CairoMenuData *data,
+                                  CairoMenuUpload upload) {
+  CairoMenuRenderData *render = &data->render;
+  if (render->upload == CAIRO_MENU_UPLOAD_DIRECT ||
+      upload == CAIRO_MENU_UPLOAD_DIRECT)
+    return upload == render->upload;
+  if (upload == render->upload)
+    return true;
+  if (upload == CAIRO_MENU_UPLOAD_SHM && !shm_extension_present(data->conn))
+    return false;
+
+  CairoMenuUpload previous = render->upload;
+  shm_fence_wait(data);
+  shm_segment_destroy(data);
+  render->upload = upload;
+  int width = render->buffer_width, height = render->buffer_height;
+  if (!backbuffer_alloc(data, width, height, true)) {
+    shm_segment_destroy(data);
+    render->upload = previous;
+    backbuffer_alloc(data, width, height, true);
+    return false;
+  }
+  cairo_menu_render_request_update(data);
+  return true;
+}
+
+/* (Re)creates the pixmap frames are uploaded to and makes it the window's
+ * background, at the back buffer size. Its contents are undefined until the
+ * next full frame. */
+static void frame_pixmap_create(CairoMenuData *data) {
+  CairoMenuRenderData *render = &data->render;
+  xcb_pixmap_t pixmap = xcb_generate_id(data->conn);
+  xcb_create_pixmap(data->conn, render->depth, pixmap, render->window,
+                    render->buffer_width, render->buffer_height);
+  xcb_change_window_attributes(data->conn, render->window, XCB_CW_BACK_PIXMAP,
+                               (const uint32_t[]){pixmap});
+  // The window holds its own reference to a background
+  if (render->frame_pixmap != XCB_NONE)
+    xcb_free_pixmap(data->conn, render->frame_pixmap);
+  render->frame_pixmap = pixmap;
+}
+
+void cairo_menu_render_bands_init(CairoMenuBands *bands,
+                                  uint32_t max_request_bytes, int stride,
+                                  int y, int height) {
+  // Request header, plus the extra length field of a big request
+  uint32_t header = sizeof(xcb_put_image_request_t) + 4;
+  int band = max_request_bytes > header && stride > 0
+                 ? (int)((max_request_bytes - header) / stride)
+                 : 1;
+  *bands = (CairoMenuBands){
+      .row = y, .rows = 0, .end = y + height, .band = band < 1 ? 1 : band};
+}
+
+bool cairo_menu_render_bands_next(CairoMenuBands *bands) {
+  bands->row += bands->rows;
+  int left = bands->end - bands->row;
+  bands->rows = left < bands->band ? left : bands->band;
+  return bands->rows > 0;
+}
+
+/* Copies rows [y, y + height) of the back buffer to the frame pixmap. From
+ * shared memory that is one ShmPutImage. Otherwise whole rows are streamed
+ * in bands as large as one request may be: a single PutImage when
+ * BIG-REQUESTS is enabled, several for a large frame without it (the core
+ * limit is 256 KiB). The server may show the frame pixmap between two bands
+ * (an expose), and without a pixmap the window itself takes them, so a
+ * banded frame can briefly tear. The rows are then cleared to the new
+ * background, a server-side copy that does nothing while the window is
+ * unmapped. */
+static void backbuffer_present(CairoMenuData *data, int y, int height) {
+  CairoMenuRenderData *render = &data->render;
+  if (y < 0) {
+    height += y;
+    y = 0;
+  }
+  if (y + height > render->height)
+    height = render->height - y;
+  if (height <= 0)
+    return;
+
+  xcb_drawable_t target = render->frame_pixmap != XCB_NONE
+                              ? render->frame_pixmap
+                              : render->window;
+  if (render->upload == CAIRO_MENU_UPLOAD_SHM) {
+    // send_event: a ShmCompletion tells us when the segment is free again
+    render->shm_fence =
+        xcb_shm_put_image(data->conn, target, render->gc, render->buffer_width,
+                          render->buffer_height, 0, y, render->width, height,
+                          0, y, render->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 1,
+                          render->shm_seg, 0)
+            .sequence;
+    render->shm_fence_pending = true;
+  } else {
+    const uint8_t *pixels = cairo_image_surface_get_data(render->surface);
+    int stride = cairo_image_surface_get_stride(render->surface);
+    if (!pixels || stride <= 0)
+      return;
+    // Whole buffer rows: the server derives their stride from the width
+    CairoMenuBands bands;
+    cairo_menu_render_bands_init(&bands, render->max_request_bytes, stride, y,
+                                 height);
+    while (cairo_menu_render_bands_next(&bands)) {
+      xcb_put_image(data->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, target, render->gc,
+                    render->buffer_width, bands.rows, 0, bands.row, 0,
+                    render->depth, bands.rows * stride,
+                    pixels + (size_t)bands.row * stride);
+    }
+  }
+
+  if (target != render->window)
+    xcb_clear_area(data->conn, 0, render->window, 0, y, render->width, height);
+}
+
+/* Ends a frame: rows [y, y + height) were drawn and are presented */
+static void render_finish(CairoMenuData *data, int y, int height) {
+  cairo_restore(data->render.cr);
+  cairo_surface_flush(data->render.surface);
+  if (data->render.upload != CAIRO_MENU_UPLOAD_DIRECT)
+    backbuffer_present(data, y, height);
+  if (data->conn)
+    xcb_flush(data->conn);
+}
+
+/* Top of the row item index is drawn at */
+static double item_row_y(const CairoMenuData *data, const MenuStyle *style,
+                         size_t index) {
+  if (data->layout.valid && index < data->layout.item_count)
+    return data->layout.rows[index].y;
+  return style->padding * 2 + style->font_size + index * style->item_height;
+}
+
+/* The background layer holds the gradient, the title and the nuance box of
+ * every row: all of the menu that does not depend on the selection. It is
+ * drawn once per window size and layout (which covers style and text), and
+ * every frame starts by copying it instead of drawing those again. */
+static bool background_update(CairoMenuData *data, const Menu *menu) {
+  CairoMenuRenderData *render = &data->render;
+  const MenuStyle *style = &menu->config.style;
+  if (!data->layout.valid)
+    return false;
+  bool same_size = render->background &&
+                   render->background_width == render->width &&
+                   render->background_height == render->height;
+  if (same_size && render->background_generation == data->layout.generation)
+    return true;
+
+  // A smaller window redraws the layer in place, like the back buffer
+  bool fits = render->background &&
+              render->width <= render->background_storage_width &&
+              render->height <= render->background_storage_height;
+  if (!fits) {
+    int width = render->width > render->background_storage_width
+                    ? render->width
+                    : render->background_storage_width;
+    int height = render->height > render->background_storage_height
+                     ? render->height
+                     : render->background_storage_height;
+    if (render->background)
+      cairo_surface_destroy(render->background);
+    render->background = cairo_surface_create_similar(
+        render->surface, CAIRO_CONTENT_COLOR, width, height);
+    if (cairo_surface_status(render->background) != CAIRO_STATUS_SUCCESS) {
+      cairo_surface_destroy(render->background);
+      render->background = NULL;
+      return false;
+    }
+    render->background_storage_width = width;
+    render->background_storage_height = height;
+  }
+
+  // The drawing helpers paint on render->cr: point it at the layer
+  cairo_t *frame = render->cr;
+  render->cr = cairo_create(render->background);
+  cairo_menu_render_clear(data, style);
+  cairo_menu_render_title(data, menu->config.title, style);
+  for (size_t i = 0; i < menu->config.item_count; i++)
+    render_item_nuance(data, style, item_row_y(data, style, i));
+  cairo_destroy(render->cr);
+  render->cr = frame;
+  cairo_surface_flush(render->background);
+
+  render->background_width = render->width;
+  render->background_height = render->height;
+  render->background_generation = data->layout.generation;
+  return true;
+}
+
+static void background_free(CairoMenuRenderData *render) {
+  if (render->background) {
+    cairo_surface_destroy(render->background);
+    render->background = NULL;
+  }
+  render->background_storage_width = render->background_storage_height = 0;
+}
+
 /* Initialize rendering */
 
 bool cairo_menu_render_init(CairoMenuData *data, xcb_connection_t *conn,
@@ -458,33 +1184,71 @@ bool cairo_menu_render_init(CairoMenuData *data, xcb_connection_t *conn,
     return false;
   }
 
-  /* Create Cairo surface */
+  /* Create Cairo surface: the back buffer if the visual allows it, in
+   * shared memory if the server can read it from there */
   // printf("Creating Cairo surface\n");
-  render->surface = cairo_xcb_surface_create(conn, render->window, visual,
-                                             render->width, render->height);
+  data->conn = conn;
+  render->surface = NULL;
+  render->cr = NULL;
+  render->gc = XCB_NONE;
+  render->frame_pixmap = XCB_NONE;
+  render->upload = CAIRO_MENU_UPLOAD_DIRECT;
+  render->shm_addr = NULL;
+  render->shm_size = 0;
+  render->shm_fence_pending = false;
+  memset(render->fonts, 0, sizeof(render->fonts));
+  memset(render->sprites, 0, sizeof(render->sprites));
+  render->sprite_clock = 0;
+  render->glyphs = (CairoMenuGlyphCache){0};
+  render->background = NULL;
+  render->translucent = false;
+  render->opacity = 1.0;
+  render->transformed = false;
+  render->offset_x = render->offset_y = 0;
+  render->scale = 1.0;
+  data->layout = (CairoMenuLayout){0};
+  render->font_clock = 0;
+  render->font_options = NULL;
+  bool ok;
+  if (backbuffer_supported(conn, screen, visual)) {
+    render->depth = screen->root_depth;
+    render->gc = xcb_generate_id(conn);
+    xcb_create_gc(conn, render->gc, render->window, 0, NULL);
+    render->max_request_bytes = backbuffer_max_request_bytes(conn);
+    render->upload = shm_extension_present(conn) ? CAIRO_MENU_UPLOAD_SHM
+                                                 : CAIRO_MENU_UPLOAD_PUT_IMAGE;
+    ok = backbuffer_alloc(data, render->width, render->height, true);
+    if (!ok && render->upload == CAIRO_MENU_UPLOAD_SHM) {
+      LOG("MIT-SHM unusable, uploading frames with PutImage");
+      render->upload = CAIRO_MENU_UPLOAD_PUT_IMAGE;
+      ok = backbuffer_alloc(data, render->width, render->height, false);
+    }
+  } else {
+    render->surface = cairo_xcb_surface_create(conn, render->window, visual,
+                                               render->width, render->height);
+    render->cr = cairo_create(render->surface);
+    ok = cairo_surface_status(render->surface) == CAIRO_STATUS_SUCCESS &&
+         cairo_status(render->cr) == CAIRO_STATUS_SUCCESS;
+  }
   // printf("Cairo surface created: %p, status=%d\n", render->surface,
   //      cairo_surface_status(render->surface));
-  if (cairo_surface_status(render->surface) != CAIRO_STATUS_SUCCESS) {
+  if (!ok) {
     // printf("Failed to create Cairo surface\n");
+    backbuffer_free(data);
+    shm_segment_destroy(data);
+    if (render->gc != XCB_NONE)
+      xcb_free_gc(conn, render->gc);
     xcb_destroy_window(conn, render->window);
     render->window = XCB_NONE; // Set to XCB_NONE after destruction
     return false;
   }
 
-  /* Create Cairo context */
-  // printf("Creating Cairo context\n");
-  render->cr = cairo_create(render->surface);
-  // printf("Cairo context created: %p, status=%d\n", render->cr,
-  // cairo_status(render->cr));
-  if (cairo_status(render->cr) != CAIRO_STATUS_SUCCESS) {
-    // printf("Failed to create Cairo context\n");
-    cairo_surface_destroy(render->surface);
-    xcb_destroy_window(conn, render->window);
-    render->window = XCB_NONE; // Set to XCB_NONE after destruction
-    return false;
-  }
+  if (render->upload != CAIRO_MENU_UPLOAD_DIRECT)
+    frame_pixmap_create(data);
+  render->font_options = cairo_font_options_create();
+  cairo_surface_get_font_options(render->surface, render->font_options);
 
-  render->needs_redraw = true;
+  cairo_menu_render_request_update(data);
   // Usage from here:
   /* cairo_set_source_rgb(render->cr, 1.0, 1.0, 1.0); */
   /* cairo_paint(render->cr); */
@@ -499,15 +1263,20 @@ void cairo_menu_render_cleanup(CairoMenuData *data) {
   LOG("Cleaning up rendering resources");
   CairoMenuRenderData *render = &data->render;
 
-  if (render->cr) {
-    cairo_destroy(render->cr);
-    render->cr = NULL;
-  }
-
-  if (render->surface) {
-    cairo_surface_destroy(render->surface);
-    render->surface = NULL;
+  background_free(render);
+  sprite_cache_clear(render);
+  glyph_cache_clear(&render->glyphs);
+  font_cache_clear(render);
+  free(data->layout.rows);
+  data->layout = (CairoMenuLayout){0};
+  if (render->font_options) {
+    cairo_font_options_destroy(render->font_options);
+    render->font_options = NULL;
   }
+  backbuffer_free(data);
+  render->shm_fence_pending = false;
+  if (data->conn)
+    shm_segment_destroy(data);
 
   // printf("Cleaning up window: %d\n", render->window); // Add debug print
   // printf("test null: %p\n", NULL);                    // Add debug print
@@ -525,6 +1294,10 @@ void cairo_menu_render_cleanup(CairoMenuData *data) {
         // %p\n",
         //       render->window,
         //       data->conn); // Add debug print
+        if (render->gc != XCB_NONE)
+          xcb_free_gc(data->conn, render->gc);
+        if (render->frame_pixmap != XCB_NONE)
+          xcb_free_pixmap(data->conn, render->frame_pixmap);
         xcb_destroy_window(data->conn, render->window);
 
         // printf("2Destroyed window: %d using connection: %p\n",
@@ -537,6 +1310,8 @@ void cairo_menu_render_cleanup(CairoMenuData *data) {
       }
     }
     render->window = XCB_NONE; // Set to XCB_NONE after destruction
+    render->gc = XCB_NONE;
+    render->frame_pixmap = XCB_NONE;
   }
 }
 
@@ -562,58 +1337,132 @@ void cairo_menu_render_show(CairoMenuData *data) {
     return;
   }
 
-  // Map the window to make it visible
-  xcb_map_window(data->conn, data->render.window);
-
-  // Force XCB to flush the request to X server immediately
-  xcb_flush(data->conn);
-  LOG("Menu window shown");
-
   // Request initial redraw explicitly
   cairo_menu_render_request_update(data);
 
   // Immediately render once
   int x_pad = 20;
   int y_pad = 30;
-  int height_pad = 0;
-  int width_pad = 20;
-  int line_height = 42;
-  int char_width = 9;
-  int min_width = 200; /* Default size */
-  xcb_screen_t *screen =
-      xcb_setup_roots_iterator(xcb_get_setup(data->conn)).data;
   /* int x = screen->width_in_pixels - width - 20; // Padding 20px */
-  int x =
-      get_window_absolute_geometry(data->conn, window_get_focused(data->conn));
+  // Monitor of the active window: tracked from events when possible
+  int active_x;
+  X11FocusContext *focus_ctx = data->menu ? data->menu->focus_ctx : NULL;
+  int x = x11_focus_active_geometry(focus_ctx, &active_x, NULL, NULL, NULL)
+              ? monitor_index(active_x)
+              : get_window_absolute_geometry(data->conn,
+                                             window_get_focused(data->conn));
 
   LOG("Window absolute geometry: x=%d", x);
 
   x = (x * 1920) + x_pad;
   LOG("Window x position: x=%d", x);
   int y = y_pad;
-  int num_items = data->menu->config.item_count;
-  int height = ((1 + num_items) * 42) + (2 * height_pad);
-  for (int i = 0; i < num_items; i++) {
-    int item_width = strlen(data->menu->config.items[i].label) * 9;
-    if (item_width > min_width) {
-      min_width = item_width;
-    }
-  }
-  min_width += (2 * width_pad);
+  int width = data->render.width, height = data->render.height;
+  cairo_menu_render_calculate_size(data, data->menu, &width, &height);
   xcb_configure_window(data->conn, data->render.window,
                        XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
                            XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                       (const uint32_t[]){x, y, min_width, height});
+                       (const uint32_t[]){x, y, width, height});
+
+  // Size the back buffer before composing the frame into it
+  cairo_menu_render_resize(data, width, height);
+
+  /* With a frame pixmap the first frame is uploaded while the window is
+   * still unmapped; the server shows it as the background on map, so the
+   * window never appears empty or at the wrong size. Drawing directly
+   * needs the window mapped first. */
+  bool prerender = data->render.frame_pixmap != XCB_NONE;
+  if (prerender)
+    cairo_menu_render_repaint(data);
+  xcb_map_window(data->conn, data->render.window);
+  if (!prerender)
+    cairo_menu_render_repaint(data);
+
+  // Force XCB to flush the request to X server immediately
+  xcb_flush(data->conn);
+  LOG("Menu window shown");
+}
+
+/* Paints the damaged part of the menu at the window's current size.
+ * Selection changes come here directly: the window is already mapped and
+ * placed, so there is no map, focus query or configure, and only the rows
+ * whose highlight changed are redrawn. */
+void cairo_menu_render_repaint(CairoMenuData *data) {
+  if (!data || !data->menu || !data->render.cr ||
+      !cairo_menu_render_needs_update(data))
+    return;
+  CairoMenuDamage *damage = &data->render.damage;
+  const Menu *menu = data->menu;
+  const MenuStyle *style = &menu->config.style;
+  cairo_t *cr = data->render.cr;
 
-  if (cairo_menu_render_needs_update(data)) {
-    cairo_menu_render_begin(data);
-    cairo_menu_render_clear(data, &data->menu->config.style);
-    cairo_menu_render_title(data, data->menu->config.title,
-                            &data->menu->config.style);
-    cairo_menu_render_items(data, data->menu);
-    cairo_menu_render_end(data);
+  int top = 0, bottom = data->render.height;
+  bool composed = data->render.translucent || data->render.transformed;
+  if (composed)
+    damage->full = true; // Fade and transform apply to the frame as a whole
+  if (damage->full)
+    cairo_menu_render_update_layout(data, menu);
+  bool layer = background_update(data, menu);
+  cairo_menu_render_begin(data);
+  if (composed)
+    cairo_push_group(cr);
+  if (damage->full && layer) {
+    cairo_set_source_surface(cr, data->render.background, 0, 0);
+    cairo_paint(cr);
+    for (size_t i = 0; i < menu->config.item_count; i++)
+      render_item_foreground(data, &menu->config.items[i], style,
+                             (int)i == menu->selected_index,
+                             item_row_y(data, style, i));
+  } else if (damage->full) {
+    cairo_menu_render_clear(data, style);
+    cairo_menu_render_title(data, menu->config.title, style);
+    cairo_menu_render_items(data, menu);
+  } else {
+    top = bottom;
+    bottom = 0;
+    for (int i = 0; i < damage->row_count; i++) {
+      const CairoMenuRect *r = &damage->rows[i];
+      int index = damage->row_index[i];
+      // The background gradient spans the window, so clipping it to the
+      // row reproduces exactly what a full repaint puts there
+      cairo_save(cr);
+      cairo_rectangle(cr, r->x, r->y, r->width, r->height);
+      cairo_clip(cr);
+      if (layer) {
+        cairo_set_source_surface(cr, data->render.background, 0, 0);
+        cairo_paint(cr);
+        render_item_foreground(data, &menu->config.items[index], style,
+                               index == menu->selected_index, r->y);
+      } else {
+        cairo_menu_render_clear(data, style);
+        cairo_menu_render_item(data, &menu->config.items[index], style,
+                               index == menu->selected_index, r->y);
+      }
+      cairo_restore(cr);
+      if (r->y < top)
+        top = (int)r->y;
+      if (r->y + r->height > bottom)
+        bottom = (int)ceil(r->y + r->height);
+    }
   }
-  cairo_menu_render_resize(data, min_width, height);
+  if (composed) {
+    // One composite per frame: the finished menu over black
+    const CairoMenuRenderData *render = &data->render;
+    cairo_pattern_t *frame = cairo_pop_group(cr);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+    if (render->transformed) {
+      cairo_translate(cr, render->offset_x + render->width / 2.0,
+                      render->offset_y + render->height / 2.0);
+      cairo_scale(cr, render->scale, render->scale);
+      cairo_translate(cr, -render->width / 2.0, -render->height / 2.0);
+    }
+    cairo_set_source(cr, frame);
+    cairo_paint_with_alpha(cr, render->translucent ? render->opacity : 1.0);
+    cairo_pattern_destroy(frame);
+  }
+  render_finish(data, top, bottom - top);
+  memset(damage, 0, sizeof(*damage));
 }
 
 void cairo_menu_render_hide(CairoMenuData *data) {
@@ -637,22 +1486,43 @@ void cairo_menu_render_resize(CairoMenuData *data, int width, int height) {
                        XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
                        values);
 
-  /* Update surface size */
-  cairo_xcb_surface_set_size(render->surface, width, height);
-  render->needs_redraw = true;
+  /* Update surface size. The back buffer and frame pixmap are kept while
+   * the window fits into them and only grow (the next frame repaints
+   * everything anyway) */
+  if (render->upload != CAIRO_MENU_UPLOAD_DIRECT) {
+    if (width > render->buffer_width || height > render->buffer_height) {
+      int buffer_width =
+          width > render->buffer_width ? width : render->buffer_width;
+      int buffer_height =
+          height > render->buffer_height ? height : render->buffer_height;
+      if (!backbuffer_alloc(data, buffer_width, buffer_height, false) &&
+          render->upload == CAIRO_MENU_UPLOAD_SHM) {
+        render->upload = CAIRO_MENU_UPLOAD_PUT_IMAGE;
+        backbuffer_alloc(data, buffer_width, buffer_height, false);
+      }
+      frame_pixmap_create(data);
+    }
+  } else {
+    cairo_xcb_surface_set_size(render->surface, width, height);
+  }
+  cairo_menu_render_request_update(data);
 }
 
 /* Rendering operations */
 void cairo_menu_render_begin(CairoMenuData *data) {
   // printf("Rendering begin\n");
+  // The previous upload must be done with the shared segment
+  shm_fence_wait(data);
   cairo_save(data->render.cr);
+  // The back buffer may be larger than the window showing it
+  cairo_rectangle(data->render.cr, 0, 0, data->render.width,
+                  data->render.height);
+  cairo_clip(data->render.cr);
 }
 
 void cairo_menu_render_end(CairoMenuData *data) {
   // printf("Rendering end\n");
-  cairo_restore(data->render.cr);
-  cairo_surface_flush(data->render.surface);
-  xcb_flush(data->conn);
+  render_finish(data, 0, data->render.height);
 }
 
 /* void cairo_menu_render_clear(CairoMenuData *data, const MenuStyle *style) {
@@ -710,55 +1580,131 @@ void cairo_menu_render_items(CairoMenuData *data, const Menu *menu) {
   // printf("Rendering items\n");
   // printf("Rendering items: data=%p, menu=%p\n", data, menu);
   const MenuStyle *style = &menu->config.style;
-  double y = style->padding * 2 + style->font_size;
   for (size_t i = 0; i < menu->config.item_count; i++) {
     // printf("Rendering item %zu: %s\n", i, menu->config.items[i].label);
     cairo_menu_render_item(data, &menu->config.items[i], style,
-                           (int)i == menu->selected_index, y);
-    y += style->item_height;
+                           (int)i == menu->selected_index,
+                           item_row_y(data, style, i));
   }
 }
 
-/* Size calculation */
-void cairo_menu_render_calculate_size(CairoMenuData *data, const Menu *menu,
-                                      int *width, int *height) {
-  cairo_t *cr = data->render.cr;
-  const MenuStyle *style = &menu->config.style;
+/*--------*/
+/* Layout */
+/*--------*/
+
+// Field by field: the struct has padding. The font face is compared by
+// pointer; edits in place go through menu_text_changed like labels do.
+static bool style_equal(const MenuStyle *a, const MenuStyle *b) {
+  for (int i = 0; i < 4; i++) {
+    if (a->background_color[i] != b->background_color[i] ||
+        a->text_color[i] != b->text_color[i] ||
+        a->highlight_color[i] != b->highlight_color[i])
+      return false;
+  }
+  return a->font_face == b->font_face && a->font_size == b->font_size &&
+         a->item_height == b->item_height && a->padding == b->padding;
+}
 
-  /* Set up font */
-  cairo_select_font_face(cr, style->font_face, CAIRO_FONT_SLANT_NORMAL,
-                         CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_size(cr, style->font_size);
+static bool layout_is_current(const CairoMenuLayout *layout,
+                              const Menu *menu) {
+  return layout->valid && layout->title == menu->config.title &&
+         layout->items == menu->config.items &&
+         layout->item_count == menu->config.item_count &&
+         layout->text_generation == menu->text_generation &&
+         style_equal(&layout->style, &menu->config.style);
+}
 
-  /* Calculate required width */
-  double max_width = 0;
+/* Ink and advance of label in the current font; converting it here also
+ * means the first paint finds its glyph run ready */
+static double label_width(CairoMenuData *data, const char *label) {
+  if (!label)
+    return 0;
   cairo_text_extents_t extents;
+  const CairoMenuGlyphRun *run = glyph_run_get(data, label);
+  if (run)
+    cairo_glyph_extents(data->render.cr, run->glyphs, run->glyph_count,
+                        &extents);
+  else
+    cairo_text_extents(data->render.cr, label, &extents);
+  return fmax(extents.x_advance, extents.x_bearing + extents.width);
+}
 
-  /* Check title width */
-  cairo_text_extents(cr, menu->config.title, &extents);
-  max_width = extents.width;
+bool cairo_menu_render_update_layout(CairoMenuData *data, const Menu *menu) {
+  CairoMenuLayout *layout = &data->layout;
+  if (!menu || !data->render.cr)
+    return false;
+  if (layout_is_current(layout, menu))
+    return true;
+
+  size_t count = menu->config.item_count;
+  if (count > layout->row_capacity) {
+    CairoMenuRect *rows = realloc(layout->rows, count * sizeof(*rows));
+    if (!rows)
+      return false;
+    layout->rows = rows;
+    layout->row_capacity = count;
+  }
 
-  /* Check menu items */
-  for (size_t i = 0; i < menu->config.item_count; i++) {
-    cairo_text_extents(cr, menu->config.items[i].label, &extents);
-    if (extents.width > max_width) {
-      max_width = extents.width;
-    }
+  const MenuStyle *style = &menu->config.style;
+  double padding = style->padding;
+  cairo_t *cr = data->render.cr;
+  cairo_font_extents_t font;
+  cairo_save(cr);
+
+  /* Title: bold, on the first baseline */
+  use_title_font(data, style);
+  cairo_font_extents(cr, &font);
+  layout->title_baseline = padding + font.ascent;
+  double width = label_width(data, menu->config.title) + padding * 2;
+
+  /* Items: text centred in the highlight, which is inset by the padding
+   * at both sides and at the bottom of a row */
+  use_item_font(data, style);
+  cairo_font_extents(cr, &font);
+  layout->item_baseline =
+      (style->item_height - padding - (font.ascent + font.descent)) / 2 +
+      font.ascent;
+  double top = padding * 2 + style->font_size;
+  for (size_t i = 0; i < count; i++) {
+    double item = label_width(data, menu->config.items[i].label) + padding * 4;
+    if (item > width)
+      width = item;
+    layout->rows[i] = (CairoMenuRect){0, top + i * style->item_height, 0,
+                                      style->item_height};
   }
+  cairo_restore(cr);
 
-  /* Calculate dimensions */
-  *width = (int)(max_width + style->padding * 2);
-  *height =
-      (int)(menu->config.item_count * style->item_height + style->padding * 2);
+  layout->width = (int)ceil(width);
+  if (layout->width < CAIRO_MENU_MIN_WIDTH)
+    layout->width = CAIRO_MENU_MIN_WIDTH;
+  layout->height = (int)ceil(top + count * style->item_height + padding);
+  for (size_t i = 0; i < count; i++)
+    layout->rows[i].width = layout->width;
+
+  layout->title = menu->config.title;
+  layout->items = menu->config.items;
+  layout->item_count = count;
+  layout->style = *style;
+  layout->text_generation = menu->text_generation;
+  layout->generation++;
+  layout->valid = true;
+  return true;
+}
+
+/* Size calculation */
+void cairo_menu_render_calculate_size(CairoMenuData *data, const Menu *menu,
+                                      int *width, int *height) {
+  if (!cairo_menu_render_update_layout(data, menu))
+    return;
+  *width = data->layout.width;
+  *height = data->layout.height;
 }
 
 /* Font handling */
 void cairo_menu_render_set_font(CairoMenuData *data, const char *face,
                                 double size, bool bold) {
-  cairo_select_font_face(data->render.cr, face, CAIRO_FONT_SLANT_NORMAL,
-                         bold ? CAIRO_FONT_WEIGHT_BOLD
-                              : CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_size(data->render.cr, size);
+  use_font(data, face, size,
+           bold ? CAIRO_FONT_WEIGHT_BOLD : CAIRO_FONT_WEIGHT_NORMAL);
 }
 
 /* Transform operations */
@@ -778,11 +1724,36 @@ void cairo_menu_render_scale(CairoMenuData *data, double sx, double sy) {
   cairo_scale(data->render.cr, sx, sy);
 }
 
-/*  */
+/* Only recorded here: repaint draws the frame into one group and paints it
+ * with this alpha, rather than re-compositing the target on every call */
 void cairo_menu_render_set_opacity(CairoMenuData *data, double opacity) {
-  cairo_push_group(data->render.cr);
-  cairo_pop_group_to_source(data->render.cr);
-  cairo_paint_with_alpha(data->render.cr, opacity);
+  CairoMenuRenderData *render = &data->render;
+  bool translucent = opacity < 1.0;
+  if (opacity < 0)
+    opacity = 0;
+  if (translucent == render->translucent &&
+      (!translucent || opacity == render->opacity))
+    return;
+  render->translucent = translucent;
+  render->opacity = translucent ? opacity : 1.0;
+  cairo_menu_render_request_update(data);
+}
+
+void cairo_menu_render_set_transform(CairoMenuData *data, double x, double y,
+                                     double scale) {
+  CairoMenuRenderData *render = &data->render;
+  if (scale <= 0)
+    scale = 1.0;
+  bool transformed = x != 0 || y != 0 || scale != 1.0;
+  if (transformed == render->transformed &&
+      (!transformed || (x == render->offset_x && y == render->offset_y &&
+                        scale == render->scale)))
+    return;
+  render->transformed = transformed;
+  render->offset_x = transformed ? x : 0;
+  render->offset_y = transformed ? y : 0;
+  render->scale = transformed ? scale : 1.0;
+  cairo_menu_render_request_update(data);
 }
 
 /* Color operations */
@@ -793,11 +1764,32 @@ void cairo_menu_render_set_color(CairoMenuData *data, const double color[4]) {
 
 /* State management */
 bool cairo_menu_render_needs_update(const CairoMenuData *data) {
-  return data->render.needs_redraw;
+  return data->render.damage.full || data->render.damage.row_count > 0;
 }
 
 void cairo_menu_render_request_update(CairoMenuData *data) {
-  data->render.needs_redraw = true;
+  data->render.damage.full = true;
+  data->render.damage.row_count = 0;
+}
+
+void cairo_menu_render_damage_row(CairoMenuData *data, int index) {
+  CairoMenuDamage *damage = &data->render.damage;
+  if (damage->full || !data->menu || index < 0 ||
+      (size_t)index >= data->menu->config.item_count)
+    return;
+  for (int i = 0; i < damage->row_count; i++) {
+    if (damage->row_index[i] == index)
+      return;
+  }
+  if (damage->row_count == CAIRO_MENU_DAMAGE_ROWS) {
+    cairo_menu_render_request_update(data);
+    return;
+  }
+  const MenuStyle *style = &data->menu->config.style;
+  damage->row_index[damage->row_count] = index;
+  damage->rows[damage->row_count++] = (CairoMenuRect){
+      0, item_row_y(data, style, index), data->render.width,
+      style->item_height};
 }
 
 /* Utility functions */
@@ -7,16 +7,154 @@
 #include "x11_focus.h"
 #include <cairo/cairo.h>
 #include <stdbool.h>
+#include <xcb/shm.h>
 #include <xcb/xcb.h>
 
-/* Menu rendering data */
+/* Damaged rows tracked individually before falling back to a full repaint */
+#define CAIRO_MENU_DAMAGE_ROWS 8
+
+typedef struct CairoMenuRect {
+  double x, y, width, height;
+} CairoMenuRect;
+
+/* What the next paint has to cover */
+typedef struct CairoMenuDamage {
+  bool full;                                  /* Whole window */
+  int row_count;                              /* Dirty rows below */
+  int row_index[CAIRO_MENU_DAMAGE_ROWS];      /* Item index of each row */
+  CairoMenuRect rows[CAIRO_MENU_DAMAGE_ROWS]; /* Row rectangles */
+} CairoMenuDamage;
+
+/* Narrowest menu window */
+#define CAIRO_MENU_MIN_WIDTH 200
+
+/* Menu geometry measured from the text. Computed once per title, item or
+ * style change and shared by painting, damage and placement. */
+typedef struct CairoMenuLayout {
+  bool valid;
+  const char *title;     /* Key: what it was computed for */
+  const MenuItem *items;
+  size_t item_count;
+  MenuStyle style;
+  unsigned long text_generation; /* Key: Menu.text_generation */
+  unsigned long generation; /* Bumped on every rebuild */
+  int width;             /* Window size */
+  int height;
+  double title_baseline; /* From the window top */
+  double item_baseline;  /* From the top of a row */
+  CairoMenuRect *rows;   /* One per item */
+  size_t row_capacity;
+} CairoMenuLayout;
+
+/* Scaled fonts kept per menu; a style needs two (title and items) */
+#define CAIRO_MENU_FONT_CACHE_SIZE 4
+
+/* A resolved font, keyed by face, size, weight and font options */
+typedef struct CairoMenuFont {
+  char *face;                    /* Family name */
+  double size;                   /* Size in user units */
+  cairo_font_weight_t weight;    /* Normal or bold */
+  cairo_font_options_t *options; /* Options it was resolved with */
+  cairo_scaled_font_t *scaled;   /* NULL if the slot is free */
+  unsigned long last_use;        /* For eviction */
+} CairoMenuFont;
+
+/* Labels are converted to glyphs once and redrawn from the cached run; the
+ * cache starts over when it reaches this many labels */
+#define CAIRO_MENU_GLYPH_CACHE_MAX 1024
+
+typedef struct CairoMenuGlyphRun {
+  const char *label;         /* Key: the label string drawn */
+  uint32_t hash;             /* Its contents when converted */
+  cairo_scaled_font_t *font; /* Font the glyphs belong to */
+  cairo_glyph_t *glyphs;     /* Relative to the text origin */
+  int glyph_count;
+} CairoMenuGlyphRun;
+
+typedef struct CairoMenuGlyphCache {
+  CairoMenuGlyphRun *runs; /* Open addressing on the label pointer */
+  size_t capacity;         /* Power of two */
+  size_t count;
+} CairoMenuGlyphCache;
+
+/* Row decorations rasterised once and stamped per row */
+#define CAIRO_MENU_SPRITE_CACHE_SIZE 8
+
+/* A rounded box of one height, either filled with a vertical gradient (a
+ * highlight) or solid (a shadow). It is 2 * cap + 1 pixels wide: the two
+ * corner columns, stamped as they are, and one middle column that is
+ * repeated to any width. */
+typedef struct CairoMenuSprite {
+  cairo_surface_t *surface; /* NULL if the slot is free */
+  cairo_pattern_t *middle;  /* The middle column, repeating */
+  int cap;                  /* Corner width in pixels */
+  bool gradient;            /* Key: highlight or shadow */
+  double radius;            /* Key */
+  double height;            /* Key */
+  double gradient_height;   /* Key: gradient span, highlights only */
+  double color[4];          /* Key */
+  unsigned long last_use;   /* For eviction */
+} CairoMenuSprite;
+
+/* How finished frames reach the window */
+typedef enum CairoMenuUpload {
+  CAIRO_MENU_UPLOAD_DIRECT,    /* No back buffer: cairo draws into the window */
+  CAIRO_MENU_UPLOAD_PUT_IMAGE, /* Back buffer pixels sent over the socket */
+  CAIRO_MENU_UPLOAD_SHM,       /* Back buffer in a MIT-SHM segment */
+} CairoMenuUpload;
+
+/* Rows [y, end) of a PutImage upload, split into bands of whole rows that
+ * each fit in one request */
+typedef struct CairoMenuBands {
+  int row;  /* First row of the current band */
+  int rows; /* Rows in the current band */
+  int end;
+  int band; /* Most rows per request */
+} CairoMenuBands;
+
+/* Menu rendering data. Frames are composed in a client-side image (the back
+ * buffer) and uploaded when complete, through shared memory when the server
+ * supports it, into a pixmap that is the window's background; the server
+ * copies it to the window, also on map and expose. If the visual does not
+ * match the image layout, cairo draws into the window directly
+ * (CAIRO_MENU_UPLOAD_DIRECT). */
 typedef struct CairoMenuRenderData {
-  xcb_window_t window;      /* X11 window */
-  cairo_surface_t *surface; /* Cairo surface */
-  cairo_t *cr;              /* Cairo context */
-  int width;                /* Window width */
-  int height;               /* Window height */
-  bool needs_redraw;        /* Redraw flag */
+  xcb_window_t window;         /* X11 window */
+  cairo_surface_t *surface;    /* Back buffer (or window surface) */
+  cairo_t *cr;                 /* Cairo context on surface */
+  CairoMenuUpload upload;      /* Chosen at init */
+  xcb_gcontext_t gc;           /* Used to copy the back buffer */
+  xcb_pixmap_t frame_pixmap;   /* Window background: the last frame */
+  uint8_t depth;               /* Window depth */
+  uint32_t max_request_bytes;  /* Largest request the server accepts */
+  xcb_shm_seg_t shm_seg;       /* Shared segment as known to the server */
+  uint8_t *shm_addr;           /* Shared segment as mapped here */
+  size_t shm_size;             /* Segment size in bytes */
+  bool shm_fence_pending;      /* Upload may still be reading the segment */
+  unsigned int shm_fence;      /* Sequence of that ShmPutImage */
+  int width;                   /* Window width */
+  int height;                  /* Window height */
+  int buffer_width;            /* Back buffer and frame pixmap size; only */
+  int buffer_height;           /* their top left shows in a smaller window */
+  CairoMenuDamage damage;      /* Pending repaint */
+  bool translucent;            /* Frames are faded to opacity */
+  double opacity;              /* Whole-menu opacity, see set_opacity */
+  bool transformed;            /* Frames are moved/scaled, see set_transform */
+  double offset_x;             /* Frame offset in pixels */
+  double offset_y;
+  double scale;                /* Frame scale around the window center */
+  cairo_font_options_t *font_options; /* Text options of the surface */
+  CairoMenuFont fonts[CAIRO_MENU_FONT_CACHE_SIZE];
+  unsigned long font_clock;
+  CairoMenuGlyphCache glyphs;  /* Converted labels */
+  CairoMenuSprite sprites[CAIRO_MENU_SPRITE_CACHE_SIZE];
+  unsigned long sprite_clock;
+  cairo_surface_t *background; /* Static layer, NULL until first drawn */
+  int background_width;        /* Window size it was drawn for */
+  int background_height;
+  int background_storage_width; /* Size of the layer surface itself */
+  int background_storage_height;
+  unsigned long background_generation; /* Layout it was drawn for */
 } CairoMenuRenderData;
 
 /* Menu animation data */
@@ -25,8 +163,7 @@ typedef struct CairoMenuAnimData {
   MenuAnimation *hide_animation;
   MenuAnimationSequence *show_sequence;
   MenuAnimationSequence *hide_sequence;
-  struct timeval last_frame;
-  bool is_animating;
+  bool is_animating; /* Registered with the shared frame clock */
 } CairoMenuAnimData;
 
 /* Combined menu data */
@@ -35,6 +172,7 @@ typedef struct CairoMenuData {
   CairoMenuRenderData render; /* Rendering data */
   CairoMenuAnimData anim;     /* Animation data */
   Menu *menu;                 /* Menu reference */
+  CairoMenuLayout layout;     /* Geometry of menu */
 } CairoMenuData;
 
 /* Rendering initialization */
@@ -48,10 +186,24 @@ void cairo_menu_render_show(CairoMenuData *data);
 void cairo_menu_render_hide(CairoMenuData *data);
 void cairo_menu_render_resize(CairoMenuData *data, int width, int height);
 
+/* Switch between PutImage and MIT-SHM uploads (benchmarks, diagnostics);
+ * false if the back buffer or shared memory is not available */
+bool cairo_menu_render_set_upload(CairoMenuData *data, CairoMenuUpload upload);
+
+/* Bands of rows [y, y + height) of a buffer with stride bytes per row for
+ * requests of at most max_request_bytes; a row that does not fit is still
+ * sent alone. next() moves to the following band, false past the end. */
+void cairo_menu_render_bands_init(CairoMenuBands *bands,
+                                  uint32_t max_request_bytes, int stride,
+                                  int y, int height);
+bool cairo_menu_render_bands_next(CairoMenuBands *bands);
+
 /* Rendering operations */
 void cairo_menu_render_begin(CairoMenuData *data);
 void cairo_menu_render_end(CairoMenuData *data);
 void cairo_menu_render_clear(CairoMenuData *data, const MenuStyle *style);
+/* Repaint the damaged area in place: no map, placement or resize */
+void cairo_menu_render_repaint(CairoMenuData *data);
 
 /* Menu content rendering */
 void cairo_menu_render_title(CairoMenuData *data, const char *title,
@@ -63,6 +215,10 @@ void cairo_menu_render_item(CairoMenuData *data, const MenuItem *item,
 
 void cairo_menu_render_items(CairoMenuData *data, const Menu *menu);
 
+/* Layout: recomputed only if the menu's text or style changed; false if
+ * there is nothing to measure with */
+bool cairo_menu_render_update_layout(CairoMenuData *data, const Menu *menu);
+
 /* Size calculation */
 void cairo_menu_render_calculate_size(CairoMenuData *data, const Menu *menu,
                                       int *width, int *height);
@@ -73,14 +229,23 @@ void cairo_menu_render_set_font(CairoMenuData *data, const char *face,
 
 /* State management */
 bool cairo_menu_render_needs_update(const CairoMenuData *data);
-void cairo_menu_render_request_update(CairoMenuData *data);
+void cairo_menu_render_request_update(CairoMenuData *data); /* Full repaint */
+void cairo_menu_render_damage_row(CairoMenuData *data, int index);
+/* ShmCompletion of this target's last upload; true if it was consumed */
+bool cairo_menu_render_handle_event(CairoMenuData *data,
+                                    const xcb_generic_event_t *event);
 
 /* Transform operations */
 void cairo_menu_render_save_state(CairoMenuData *data);
 void cairo_menu_render_restore_state(CairoMenuData *data);
 void cairo_menu_render_translate(CairoMenuData *data, double x, double y);
 void cairo_menu_render_scale(CairoMenuData *data, double sx, double sy);
+/* Opacity of the whole menu from the next frame on; applied once per frame */
 void cairo_menu_render_set_opacity(CairoMenuData *data, double opacity);
+/* Offset and scale of the whole menu from the next frame on, composed like
+ * the opacity; (0, 0, 1) is the identity */
+void cairo_menu_render_set_transform(CairoMenuData *data, double x, double y,
+                                     double scale);
 
 /* Color operations */
 void cairo_menu_render_set_color(CairoMenuData *data, const double color[4]);
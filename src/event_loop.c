@@ -0,0 +1,315 @@
+/* event_loop.c - epoll event loop with timerfd-backed deadlines */
+
+#include "event_loop.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef MENU_DEBUG
+#define LOG_PREFIX "[LOOP]"
+#endif
+#include "log.h"
+
+#define EVENT_LOOP_MAX_EVENTS 16
+
+typedef struct {
+  int fd;
+  EventLoopFdFn fn;
+  void *user_data;
+} FdWatch;
+
+typedef struct {
+  uint64_t deadline;
+  EventLoopTimer id;
+  EventLoopTimerFn fn;
+  void *user_data;
+} TimerEntry;
+
+struct EventLoop {
+  int epoll_fd;
+  int timer_fd;
+  FdWatch *watches;
+  size_t watch_count;
+  size_t watch_capacity;
+  TimerEntry *timers; /* Min-heap on (deadline, id) */
+  size_t timer_count;
+  size_t timer_capacity;
+  EventLoopTimer next_id;
+  uint64_t armed; /* Deadline the timerfd is set to, UINT64_MAX if disarmed */
+};
+
+uint64_t event_loop_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*-------------*/
+/* Timer heap  */
+/*-------------*/
+
+static bool timer_before(const TimerEntry *a, const TimerEntry *b) {
+  return a->deadline < b->deadline ||
+         (a->deadline == b->deadline && a->id < b->id);
+}
+
+static void timer_swap(EventLoop *loop, size_t a, size_t b) {
+  TimerEntry tmp = loop->timers[a];
+  loop->timers[a] = loop->timers[b];
+  loop->timers[b] = tmp;
+}
+
+static void timer_sift_up(EventLoop *loop, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!timer_before(&loop->timers[i], &loop->timers[parent]))
+      break;
+    timer_swap(loop, i, parent);
+    i = parent;
+  }
+}
+
+static void timer_sift_down(EventLoop *loop, size_t i) {
+  for (;;) {
+    size_t smallest = i, left = 2 * i + 1, right = left + 1;
+    if (left < loop->timer_count &&
+        timer_before(&loop->timers[left], &loop->timers[smallest]))
+      smallest = left;
+    if (right < loop->timer_count &&
+        timer_before(&loop->timers[right], &loop->timers[smallest]))
+      smallest = right;
+    if (smallest == i)
+      break;
+    timer_swap(loop, i, smallest);
+    i = smallest;
+  }
+}
+
+static void timer_remove_at(EventLoop *loop, size_t i) {
+  loop->timer_count--;
+  if (i == loop->timer_count)
+    return;
+  loop->timers[i] = loop->timers[loop->timer_count];
+  timer_sift_up(loop, i);
+  timer_sift_down(loop, i);
+}
+
+/* Points the timerfd at the earliest deadline; only touched on change */
+static void timer_rearm(EventLoop *loop) {
+  uint64_t deadline = event_loop_next_deadline(loop);
+  if (deadline == loop->armed)
+    return;
+  struct itimerspec spec = {0};
+  if (deadline != UINT64_MAX) {
+    // A zero it_value would disarm; deadlines in the past fire at once
+    uint64_t at = deadline ? deadline : 1;
+    spec.it_value.tv_sec = at / 1000;
+    spec.it_value.tv_nsec = (at % 1000) * 1000000;
+  }
+  if (timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+    LOG("timerfd_settime failed: errno %d", errno);
+    return;
+  }
+  loop->armed = deadline;
+}
+
+/*-----------*/
+/* Lifecycle */
+/*-----------*/
+
+EventLoop *event_loop_create(void) {
+  EventLoop *loop = calloc(1, sizeof(EventLoop));
+  if (!loop)
+    return NULL;
+  loop->armed = UINT64_MAX;
+  loop->next_id = 1;
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->timer_fd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = loop->timer_fd};
+  if (loop->epoll_fd < 0 || loop->timer_fd < 0 ||
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &ev) < 0) {
+    LOG("Failed to create event loop: errno %d", errno);
+    if (loop->epoll_fd >= 0)
+      close(loop->epoll_fd);
+    if (loop->timer_fd >= 0)
+      close(loop->timer_fd);
+    free(loop);
+    return NULL;
+  }
+  return loop;
+}
+
+void event_loop_destroy(EventLoop *loop) {
+  if (!loop)
+    return;
+  close(loop->timer_fd);
+  close(loop->epoll_fd);
+  free(loop->watches);
+  free(loop->timers);
+  free(loop);
+}
+
+/*------------------*/
+/* File descriptors */
+/*------------------*/
+
+static FdWatch *watch_find(EventLoop *loop, int fd) {
+  for (size_t i = 0; i < loop->watch_count; i++) {
+    if (loop->watches[i].fd == fd)
+      return &loop->watches[i];
+  }
+  return NULL;
+}
+
+bool event_loop_add_fd(EventLoop *loop, int fd, uint32_t events,
+                       EventLoopFdFn fn, void *user_data) {
+  if (!loop || fd < 0 || !fn || watch_find(loop, fd))
+    return false;
+  if (loop->watch_count == loop->watch_capacity) {
+    size_t capacity = loop->watch_capacity ? loop->watch_capacity * 2 : 4;
+    FdWatch *watches = realloc(loop->watches, capacity * sizeof(FdWatch));
+    if (!watches)
+      return false;
+    loop->watches = watches;
+    loop->watch_capacity = capacity;
+  }
+  struct epoll_event ev = {.events = events, .data.fd = fd};
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    LOG("Failed to watch fd %d: errno %d", fd, errno);
+    return false;
+  }
+  loop->watches[loop->watch_count++] = (FdWatch){fd, fn, user_data};
+  return true;
+}
+
+void event_loop_remove_fd(EventLoop *loop, int fd) {
+  FdWatch *watch = loop ? watch_find(loop, fd) : NULL;
+  if (!watch)
+    return;
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  *watch = loop->watches[--loop->watch_count];
+}
+
+/*--------*/
+/* Timers */
+/*--------*/
+
+EventLoopTimer event_loop_add_timer(EventLoop *loop, uint64_t deadline_ms,
+                                    EventLoopTimerFn fn, void *user_data) {
+  if (!loop || !fn)
+    return 0;
+  if (loop->timer_count == loop->timer_capacity) {
+    size_t capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 8;
+    TimerEntry *timers = realloc(loop->timers, capacity * sizeof(TimerEntry));
+    if (!timers)
+      return 0;
+    loop->timers = timers;
+    loop->timer_capacity = capacity;
+  }
+  EventLoopTimer id = loop->next_id++;
+  loop->timers[loop->timer_count] = (TimerEntry){deadline_ms, id, fn, user_data};
+  timer_sift_up(loop, loop->timer_count++);
+  timer_rearm(loop);
+  return id;
+}
+
+static bool timer_find(EventLoop *loop, EventLoopTimer timer, size_t *index) {
+  for (size_t i = 0; loop && timer && i < loop->timer_count; i++) {
+    if (loop->timers[i].id == timer) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool event_loop_cancel_timer(EventLoop *loop, EventLoopTimer timer) {
+  size_t i;
+  if (!timer_find(loop, timer, &i))
+    return false;
+  timer_remove_at(loop, i);
+  timer_rearm(loop);
+  return true;
+}
+
+bool event_loop_reschedule_timer(EventLoop *loop, EventLoopTimer timer,
+                                 uint64_t deadline_ms) {
+  size_t i;
+  if (!timer_find(loop, timer, &i))
+    return false;
+  loop->timers[i].deadline = deadline_ms;
+  timer_sift_up(loop, i);
+  timer_sift_down(loop, i);
+  timer_rearm(loop);
+  return true;
+}
+
+uint64_t event_loop_next_deadline(EventLoop *loop) {
+  return loop && loop->timer_count ? loop->timers[0].deadline : UINT64_MAX;
+}
+
+int event_loop_timeout(EventLoop *loop) {
+  uint64_t deadline = event_loop_next_deadline(loop);
+  if (deadline == UINT64_MAX)
+    return -1;
+  uint64_t now = event_loop_now_ms();
+  if (deadline <= now)
+    return 0;
+  uint64_t wait = deadline - now;
+  return wait > INT32_MAX ? INT32_MAX : (int)wait;
+}
+
+int event_loop_get_fd(EventLoop *loop) { return loop ? loop->epoll_fd : -1; }
+
+/*----------*/
+/* Dispatch */
+/*----------*/
+
+int event_loop_dispatch(EventLoop *loop, int timeout_ms) {
+  if (!loop)
+    return -1;
+
+  struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+  int ready = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS,
+                         timeout_ms);
+  if (ready < 0)
+    return errno == EINTR ? 0 : -1;
+
+  int ran = 0;
+  for (int i = 0; i < ready; i++) {
+    int fd = events[i].data.fd;
+    if (fd == loop->timer_fd) {
+      uint64_t expirations;
+      ssize_t n = read(fd, &expirations, sizeof(expirations));
+      (void)n; // Due timers are found from the heap below
+      // Expired: a timer re-added for the same deadline must arm it again
+      loop->armed = UINT64_MAX;
+      continue;
+    }
+    // Looked up per event: an earlier callback may have removed it
+    FdWatch *watch = watch_find(loop, fd);
+    if (watch) {
+      watch->fn(fd, events[i].events, watch->user_data);
+      ran++;
+    }
+  }
+
+  // Timers scheduled by these callbacks wait for the next dispatch, even if
+  // already due, so a callback rescheduling itself cannot starve the fds
+  uint64_t now = event_loop_now_ms();
+  EventLoopTimer last_id = loop->next_id;
+  while (loop->timer_count && loop->timers[0].deadline <= now &&
+         loop->timers[0].id < last_id) {
+    TimerEntry due = loop->timers[0];
+    timer_remove_at(loop, 0);
+    due.fn(due.user_data);
+    ran++;
+  }
+  timer_rearm(loop);
+  return ran;
+}
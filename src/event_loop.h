@@ -0,0 +1,57 @@
+/* event_loop.h - epoll event loop with timerfd-backed deadlines */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* File descriptors are watched with epoll; timers are kept in a min-heap
+ * ordered by deadline and a single timerfd is armed for the earliest one,
+ * so the loop sleeps until exactly the next deadline and indefinitely when
+ * none is scheduled.
+ *
+ * Embedding: event_loop_get_fd() becomes readable whenever a watched fd is
+ * ready or a timer is due. Add it to a foreign poll/epoll set and call
+ * event_loop_dispatch(loop, 0) when it fires, or use
+ * event_loop_next_deadline() to fold the deadline into another timeout. */
+
+typedef struct EventLoop EventLoop;
+
+typedef void (*EventLoopFdFn)(int fd, uint32_t events, void *user_data);
+typedef void (*EventLoopTimerFn)(void *user_data);
+
+/* Timer handle; 0 is never a valid id */
+typedef unsigned long EventLoopTimer;
+
+EventLoop *event_loop_create(void);
+void event_loop_destroy(EventLoop *loop);
+
+/* Current CLOCK_MONOTONIC time; deadlines are expressed on this clock */
+uint64_t event_loop_now_ms(void);
+
+/* events is an EPOLLIN/EPOLLOUT mask; one callback per fd */
+bool event_loop_add_fd(EventLoop *loop, int fd, uint32_t events,
+                       EventLoopFdFn fn, void *user_data);
+void event_loop_remove_fd(EventLoop *loop, int fd);
+
+/* One-shot timer firing at the absolute deadline_ms */
+EventLoopTimer event_loop_add_timer(EventLoop *loop, uint64_t deadline_ms,
+                                    EventLoopTimerFn fn, void *user_data);
+/* Both return false if the timer already fired or was cancelled */
+bool event_loop_cancel_timer(EventLoop *loop, EventLoopTimer timer);
+bool event_loop_reschedule_timer(EventLoop *loop, EventLoopTimer timer,
+                                 uint64_t deadline_ms);
+
+/* Earliest pending deadline, or UINT64_MAX when no timer is scheduled */
+uint64_t event_loop_next_deadline(EventLoop *loop);
+/* Milliseconds until the next deadline as a poll() timeout: -1 when idle */
+int event_loop_timeout(EventLoop *loop);
+int event_loop_get_fd(EventLoop *loop);
+
+/* Waits up to timeout_ms (-1: until the next deadline or fd activity), then
+ * runs ready fd callbacks and every due timer. Returns the number of
+ * callbacks run, or -1 on error. */
+int event_loop_dispatch(EventLoop *loop, int timeout_ms);
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,188 @@
+/* frame_clock.c - Fixed-rate animation clock on CLOCK_MONOTONIC */
+
+#include "frame_clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef MENU_DEBUG
+#define LOG_PREFIX "[FRAME_CLOCK]"
+#endif
+#include "log.h"
+
+#define FRAME_CLOCK_MIN_HZ 1.0
+#define FRAME_CLOCK_MAX_HZ 1000.0
+
+static FrameClock shared_clock;
+static bool shared_initialized = false;
+
+uint64_t frame_clock_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void frame_clock_init(FrameClock *clock, double rate_hz) {
+  memset(clock, 0, sizeof(FrameClock));
+  frame_clock_set_rate(clock, rate_hz);
+}
+
+FrameClock *frame_clock_shared(void) {
+  if (!shared_initialized) {
+    frame_clock_init(&shared_clock, FRAME_CLOCK_DEFAULT_HZ);
+    shared_initialized = true;
+  }
+  return &shared_clock;
+}
+
+void frame_clock_set_rate(FrameClock *clock, double rate_hz) {
+  if (rate_hz < FRAME_CLOCK_MIN_HZ)
+    rate_hz = FRAME_CLOCK_MIN_HZ;
+  if (rate_hz > FRAME_CLOCK_MAX_HZ)
+    rate_hz = FRAME_CLOCK_MAX_HZ;
+  // Applies from the next frame on; the pending deadline stays
+  clock->interval_us = (uint64_t)(1000000.0 / rate_hz + 0.5);
+}
+
+double frame_clock_get_rate(const FrameClock *clock) {
+  return 1000000.0 / clock->interval_us;
+}
+
+/*-----------*/
+/* Animators */
+/*-----------*/
+
+// Drops removed slots; deferred while ticking so indices stay valid
+static void animators_compact(FrameClock *clock) {
+  size_t kept = 0;
+  for (size_t i = 0; i < clock->count; i++) {
+    if (clock->animators[i].fn)
+      clock->animators[kept++] = clock->animators[i];
+  }
+  clock->count = kept;
+}
+
+bool frame_clock_add(FrameClock *clock, FrameClockAnimateFn fn,
+                     void *user_data) {
+  if (!clock || !fn)
+    return false;
+  for (size_t i = 0; i < clock->count; i++) {
+    if (clock->animators[i].fn == fn &&
+        clock->animators[i].user_data == user_data)
+      return true;
+  }
+  if (clock->count == FRAME_CLOCK_MAX_ANIMATORS) {
+    LOG("No free animator slot");
+    return false;
+  }
+  // The first frame of a new run is one interval from now
+  if (!frame_clock_is_running(clock))
+    clock->next_frame_us = frame_clock_now_us() + clock->interval_us;
+  clock->animators[clock->count++] = (FrameClockAnimator){fn, user_data};
+  return true;
+}
+
+void frame_clock_remove(FrameClock *clock, void *user_data) {
+  if (!clock)
+    return;
+  for (size_t i = 0; i < clock->count; i++) {
+    if (clock->animators[i].user_data == user_data)
+      clock->animators[i].fn = NULL;
+  }
+  if (!clock->ticking)
+    animators_compact(clock);
+}
+
+static bool animate_animation(void *user_data, double delta_ms) {
+  menu_animation_update(user_data, delta_ms);
+  return menu_animation_is_running(user_data);
+}
+
+static bool animate_sequence(void *user_data, double delta_ms) {
+  menu_animation_sequence_update(user_data, delta_ms);
+  return menu_animation_sequence_is_running(user_data);
+}
+
+bool frame_clock_add_animation(FrameClock *clock, MenuAnimation *anim) {
+  return anim && frame_clock_add(clock, animate_animation, anim);
+}
+
+bool frame_clock_add_sequence(FrameClock *clock, MenuAnimationSequence *seq) {
+  return seq && frame_clock_add(clock, animate_sequence, seq);
+}
+
+/*---------*/
+/* Ticking */
+/*---------*/
+
+bool frame_clock_is_running(const FrameClock *clock) {
+  for (size_t i = 0; clock && i < clock->count; i++) {
+    if (clock->animators[i].fn)
+      return true;
+  }
+  return false;
+}
+
+uint64_t frame_clock_next_deadline(const FrameClock *clock) {
+  return frame_clock_is_running(clock) ? clock->next_frame_us : UINT64_MAX;
+}
+
+unsigned frame_clock_tick(FrameClock *clock, uint64_t now_us) {
+  if (!frame_clock_is_running(clock) || now_us < clock->next_frame_us)
+    return 0;
+
+  // Catch up on whole intervals only, keeping the frame grid
+  uint64_t late_us = now_us - clock->next_frame_us;
+  uint64_t intervals = 1 + late_us / clock->interval_us;
+  clock->next_frame_us += intervals * clock->interval_us;
+  double delta_ms = intervals * clock->interval_us / 1000.0;
+
+  uint64_t start = frame_clock_now_us();
+  clock->ticking = true;
+  // Animators added by these callbacks start with the next frame
+  size_t count = clock->count;
+  for (size_t i = 0; i < count; i++) {
+    FrameClockAnimator *animator = &clock->animators[i];
+    if (animator->fn && !animator->fn(animator->user_data, delta_ms))
+      animator->fn = NULL;
+  }
+  clock->ticking = false;
+  animators_compact(clock);
+
+  FrameClockStats *stats = &clock->stats;
+  double frame_ms = (frame_clock_now_us() - start) / 1000.0;
+  stats->frames++;
+  stats->missed += intervals - 1;
+  stats->last_frame_ms = frame_ms;
+  stats->total_frame_ms += frame_ms;
+  if (frame_ms > stats->max_frame_ms)
+    stats->max_frame_ms = frame_ms;
+  if (late_us / 1000.0 > stats->max_late_ms)
+    stats->max_late_ms = late_us / 1000.0;
+  return (unsigned)intervals;
+}
+
+/*-------*/
+/* Stats */
+/*-------*/
+
+const FrameClockStats *frame_clock_stats(const FrameClock *clock) {
+  return clock ? &clock->stats : NULL;
+}
+
+void frame_clock_stats_reset(FrameClock *clock) {
+  if (clock)
+    memset(&clock->stats, 0, sizeof(FrameClockStats));
+}
+
+int frame_clock_stats_format(const FrameClock *clock, char *buf, size_t size) {
+  if (!clock || !buf || size == 0)
+    return 0;
+  const FrameClockStats *stats = &clock->stats;
+  double avg = stats->frames ? stats->total_frame_ms / stats->frames : 0.0;
+  return snprintf(buf, size,
+                  "Frames: %lu at %.0f Hz, %lu missed, frame time avg %.2f "
+                  "ms max %.2f ms, max late %.2f ms\n",
+                  stats->frames, frame_clock_get_rate(clock), stats->missed,
+                  avg, stats->max_frame_ms, stats->max_late_ms);
+}
@@ -0,0 +1,72 @@
+/* frame_clock.h - Fixed-rate animation clock on CLOCK_MONOTONIC */
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include "menu_animation.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_CLOCK_DEFAULT_HZ 60
+#define FRAME_CLOCK_MAX_ANIMATORS 16
+
+/* Advances one animation by delta_ms; returning false (finished)
+ * unregisters it */
+typedef bool (*FrameClockAnimateFn)(void *user_data, double delta_ms);
+
+typedef struct {
+  FrameClockAnimateFn fn; /* NULL once removed */
+  void *user_data;
+} FrameClockAnimator;
+
+typedef struct {
+  unsigned long frames; /* Ticks that advanced the animations */
+  unsigned long missed; /* Frame deadlines passed without a tick */
+  double last_frame_ms; /* Time spent advancing the last frame */
+  double max_frame_ms;
+  double total_frame_ms; /* Sum over all frames, for the average */
+  double max_late_ms;    /* Worst tick lateness past its deadline */
+} FrameClockStats;
+
+/* Frames are ticked on a fixed grid of 1/rate intervals that starts when the
+ * first animator is added; the clock is idle (no deadline) whenever nothing
+ * is registered. Every tick advances all animators by a whole number of
+ * intervals, so an animation takes the same steps however late the loop
+ * wakes up; a late tick catches up and counts the skipped frames as missed. */
+typedef struct FrameClock {
+  uint64_t interval_us;
+  uint64_t next_frame_us; /* Deadline of the next tick while running */
+  FrameClockAnimator animators[FRAME_CLOCK_MAX_ANIMATORS];
+  size_t count;
+  bool ticking; /* Inside frame_clock_tick */
+  FrameClockStats stats;
+} FrameClock;
+
+uint64_t frame_clock_now_us(void);
+
+void frame_clock_init(FrameClock *clock, double rate_hz);
+/* Process-wide clock shared by all menus */
+FrameClock *frame_clock_shared(void);
+void frame_clock_set_rate(FrameClock *clock, double rate_hz);
+double frame_clock_get_rate(const FrameClock *clock);
+
+/* Registering the same fn/user_data pair twice is a no-op */
+bool frame_clock_add(FrameClock *clock, FrameClockAnimateFn fn,
+                     void *user_data);
+/* Drops every animator registered with user_data */
+void frame_clock_remove(FrameClock *clock, void *user_data);
+bool frame_clock_add_animation(FrameClock *clock, MenuAnimation *anim);
+bool frame_clock_add_sequence(FrameClock *clock, MenuAnimationSequence *seq);
+
+bool frame_clock_is_running(const FrameClock *clock);
+/* Monotonic deadline of the next frame (us), UINT64_MAX when idle */
+uint64_t frame_clock_next_deadline(const FrameClock *clock);
+/* Advances all animators if a frame is due at now_us; returns the number of
+ * intervals advanced (0 if no frame was due) */
+unsigned frame_clock_tick(FrameClock *clock, uint64_t now_us);
+
+const FrameClockStats *frame_clock_stats(const FrameClock *clock);
+void frame_clock_stats_reset(FrameClock *clock);
+int frame_clock_stats_format(const FrameClock *clock, char *buf, size_t size);
+
+#endif /* FRAME_CLOCK_H */
@@ -1,11 +1,15 @@
 /* input_handler.c - Complete and updated Input handling implementation */
 #include "input_handler.h"
 #include "cairo_menu.h" // Include cairo_menu.h for menu_setup_cairo
+#include "cairo_menu_render.h"
+#include "event_loop.h"
+#include "frame_clock.h"
 #include "menu_manager.h"
+#include "x11_atoms.h"
+#include "x11_stats.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
 #include <unistd.h> // For usleep
 #include <xcb/xcb_ewmh.h>
 
@@ -85,6 +89,7 @@ bool input_handler_setup_x(InputHandler *handler) {
   xcb_ewmh_connection_t *ewmh = NULL;
   xcb_screen_t *screen = NULL;
   xcb_window_t root = XCB_NONE;
+  x11_op_enter(X11_OP_SETUP);
 
   // Retry connection logic for robustness, especially under Xvfb
   int retries = 7;
@@ -121,8 +126,15 @@ bool input_handler_setup_x(InputHandler *handler) {
     goto fail_conn;
   }
 
-  if (!xcb_ewmh_init_atoms_replies(ewmh, xcb_ewmh_init_atoms(conn, ewmh),
-                                   NULL)) {
+  // Send the EWMH intern batch first so our own atoms share its round-trip
+  xcb_intern_atom_cookie_t *ewmh_cookies = xcb_ewmh_init_atoms(conn, ewmh);
+  x11_rt_batch_begin();
+  if (!x11_atoms_init(conn))
+    fprintf(stderr, "[WARN] Failed to intern some atoms\n");
+  bool ewmh_ok =
+      X11_SYNC_OK(xcb_ewmh_init_atoms_replies(ewmh, ewmh_cookies, NULL));
+  x11_rt_batch_end();
+  if (!ewmh_ok) {
     fprintf(stderr, "[ERROR] Failed to initialize EWMH\n");
     goto fail_conn;
   }
@@ -149,16 +161,31 @@ bool input_handler_setup_x(InputHandler *handler) {
   handler->modifier_mask = 0; // Initialize modifier mask
 
   menu_manager_connect(handler->menu_manager, conn, handler->focus_ctx, ewmh);
+  // A resident process places its menus from the tracked active window; a
+  // one-shot run shows one menu and asks once instead
+  if (handler->daemon_mode)
+    x11_focus_track_active(handler->focus_ctx);
+  // A resident process creates its menu windows now, not on the first
+  // trigger key press; if this fails (or for a one-shot run, which shows a
+  // single menu) menus set up their own on activation
+  if (handler->daemon_mode)
+    handler->menu_pool =
+        cairo_menu_pool_create(conn, root, handler->focus_ctx, screen);
   // x11_set_window_floating(handler->focus_ctx, root); // Is this needed
   // here? Maybe in menu activation?
 
-  if (!x11_grab_inputs(handler->focus_ctx, root)) {
+  if (handler->daemon_mode) {
+    // A resident process must not hold the keyboard all day: listen for the
+    // trigger keys only and grab actively while a menu is visible.
+    input_handler_grab_triggers(handler);
+  } else if (!x11_grab_inputs(handler->focus_ctx, root)) {
     fprintf(stderr, "[INPUT] Failed to grab inputs\n");
     goto fail_focus; // Cleanup focus context and root window memory
   }
 
   // Additional initialization steps...
   LOG("[SETUP] Input handler X setup successful");
+  x11_op_leave();
   return true; // Success
 
 fail_focus:
@@ -178,12 +205,14 @@ fail_conn:
     handler->ewmh = NULL; // Prevent double free in destroy
   }
   if (conn) {
+    x11_atoms_reset();
     xcb_disconnect(conn);
     handler->conn = NULL; // Prevent double free in destroy
   }
   // Note: handler itself is not freed here, caller should handle it
   // menu_manager is also not destroyed here, handled by input_handler_destroy
   LOG("[SETUP] Input handler X setup failed");
+  x11_op_leave();
   return false; // Failure
 }
 /* void input_handler_setup_x(InputHandler *handler) { */
@@ -303,9 +332,19 @@ void input_handler_destroy(InputHandler *handler) {
     handler->menu_manager = NULL;
   }
 
+  // After the menus: they hand their targets back when destroyed
+  LOG("[DESTROY] Destroying input handler:menu pool");
+  cairo_menu_pool_destroy(handler->menu_pool);
+  handler->menu_pool = NULL;
+
+  LOG("[DESTROY] Destroying input handler:event loop");
+  event_loop_destroy(handler->loop);
+  handler->loop = NULL;
+
   LOG("[DESTROY] Destroying input handler:conn");
   if (handler->conn) {
     // No need to check for errors, just disconnect if it exists
+    x11_atoms_reset();
     xcb_disconnect(handler->conn);
     handler->conn = NULL;
   }
@@ -320,65 +359,177 @@ void input_handler_destroy(InputHandler *handler) {
   free(handler);
 }
 
-static bool update_callback(Menu *menu, struct timeval *last_update,
-                            void *user_data) {
-  struct timeval now;
-  gettimeofday(&now, NULL);
+// Hands a shared-memory upload completion to the menu that sent it
+static bool route_upload_completion(Menu *menu, uint64_t *last_update,
+                                    void *user_data) {
+  (void)last_update;
+  return !(menu_cairo_is_setup(menu) &&
+           cairo_menu_render_handle_event(menu->user_data, user_data));
+}
 
-  if (!menu->active || menu->update_interval <= 0 || !menu->update_cb)
+// Runs the update of every active menu that is due and lowers
+// *(uint64_t *)user_data to the earliest upcoming one (monotonic ms)
+static bool update_callback(Menu *menu, uint64_t *last_update,
+                            void *user_data) {
+  uint64_t *next_deadline = user_data;
+  unsigned long interval = menu->update_interval;
+  if (!menu->active || interval == 0 || !menu->update_cb)
     return true;
 
-  unsigned long elapsed = (now.tv_sec - last_update->tv_sec) * 1000 +
-                          (now.tv_usec - last_update->tv_usec) / 1000;
-  if (elapsed >= menu->update_interval) {
+  // One clock for both: wall-clock steps cannot skew the schedule
+  uint64_t now = event_loop_now_ms();
+  if (now - *last_update >= interval) {
     menu_trigger_update(menu);
     *last_update = now;
   }
+  uint64_t deadline = *last_update + interval;
+  if (deadline < *next_deadline)
+    *next_deadline = deadline;
   return true;
 }
 
-void input_handler_run(InputHandler *handler) {
-  if (!handler)
-    return;
-
-  int fd = xcb_get_file_descriptor(handler->conn);
-  while (1) {
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
-
-    struct timeval timeout = {0};
-    timeout.tv_sec = 1; // fallback timeout
-
-    int ret = select(fd + 1, &fds, NULL, NULL, &timeout);
+// The timer only wakes the loop; updates run after every dispatch
+static void on_update_due(void *user_data) {
+  InputHandler *handler = user_data;
+  handler->update_timer = 0;
+}
 
-    if (ret > 0) {
-      xcb_generic_event_t *event;
-      while ((event = xcb_poll_for_event(handler->conn))) {
-        LOG("Incoming event");
+// Readiness only wakes the loop; events are drained after every dispatch,
+// which also picks up events xcb queued while waiting for a reply
+static void on_x11_readable(int fd, uint32_t events, void *user_data) {
+  (void)fd;
+  (void)events;
+  (void)user_data;
+}
 
-        if (input_handler_handle_event(handler, event)) {
-          LOG("Exiting loop");
-          free(event);
-          return;
-        }
+// Returns true when a menu interaction ends the (non-daemon) loop.
+// Pending events are handled as one burst; selection moves only record
+// damage and are applied on the next frame (see menu_flush_selection). A
+// burst is cut off after one frame interval so that frame is not delayed.
+static bool input_handler_drain_events(InputHandler *handler) {
+  uint64_t burst_end = frame_clock_now_us() + frame_clock_shared()->interval_us;
+  bool finished = false;
+  handler->input_pending = false;
+  xcb_generic_event_t *event;
+  while ((event = x11_focus_poll_event(handler->focus_ctx))) {
+    LOG("Incoming event");
+
+    if (input_handler_handle_event(handler, event)) {
+      if (!handler->daemon_mode) {
+        LOG("Exiting loop");
         free(event);
+        finished = true;
+        break;
       }
+      // Daemon mode: connection, EWMH state, menus and their Cairo
+      // surfaces stay resident for the next activation.
+      LOG("Menu interaction finished, staying resident");
+      if (handler->menu_manager->active_menu)
+        menu_manager_deactivate(handler->menu_manager);
     }
+    free(event);
+    if (frame_clock_now_us() >= burst_end) {
+      // The rest may sit in xcb's queue, invisible to epoll
+      handler->input_pending = true;
+      break;
+    }
+  }
+  return finished;
+}
 
-    menu_manager_foreach(handler->menu_manager, update_callback, NULL);
+EventLoop *input_handler_get_loop(InputHandler *handler) {
+  if (!handler || !handler->conn)
+    return NULL;
+  if (handler->loop)
+    return handler->loop;
+  handler->loop = event_loop_create();
+  if (!handler->loop)
+    return NULL;
+  if (!event_loop_add_fd(handler->loop, xcb_get_file_descriptor(handler->conn),
+                         EPOLLIN, on_x11_readable, handler)) {
+    event_loop_destroy(handler->loop);
+    handler->loop = NULL;
+  }
+  return handler->loop;
+}
 
-    if (xcb_connection_has_error(handler->conn)) {
-      LOG("X11 connection error detected, exiting loop");
-      break;
+bool input_handler_dispatch(InputHandler *handler, int timeout_ms) {
+  EventLoop *loop = input_handler_get_loop(handler);
+  if (!loop)
+    return true;
+
+  // Events read while waiting for a grab are already off the socket
+  if (handler->input_pending ||
+      x11_focus_has_deferred_events(handler->focus_ctx))
+    timeout_ms = 0;
+  if (timeout_ms != 0 && handler->focus_ctx) {
+    // So are events xcb read along with a reply: the fd stays quiet for
+    // them, so look before sleeping (after sending what we queued)
+    xcb_flush(handler->conn);
+    xcb_generic_event_t *queued = xcb_poll_for_queued_event(handler->conn);
+    if (queued) {
+      x11_focus_defer_event(handler->focus_ctx, queued);
+      timeout_ms = 0;
     }
   }
+  if (event_loop_dispatch(loop, timeout_ms) < 0) {
+    LOG("Event loop error, exiting loop");
+    return true;
+  }
+  if (input_handler_drain_events(handler))
+    return true;
+
+  // Hand the keyboard back as soon as no menu is showing
+  if (handler->grab_active && !handler->menu_manager->active_menu) {
+    LOG("Releasing active grab");
+    x11_ungrab_inputs(handler->focus_ctx);
+    handler->grab_active = false;
+  }
+
+  // Animation frames run on the shared frame clock's grid
+  FrameClock *clock = frame_clock_shared();
+  frame_clock_tick(clock, frame_clock_now_us());
+
+  // Sleep until exactly the next update or animation frame; with nothing
+  // scheduled the loop only wakes for X input
+  uint64_t next_deadline = UINT64_MAX;
+  menu_manager_foreach(handler->menu_manager, update_callback, &next_deadline);
+  uint64_t next_frame = frame_clock_next_deadline(clock);
+  if (next_frame != UINT64_MAX) {
+    next_frame = (next_frame + 999) / 1000; // Never wake before the frame
+    if (next_frame < next_deadline)
+      next_deadline = next_frame;
+  }
+  // (the timerfd itself is only reprogrammed when the deadline moves)
+  if (next_deadline == UINT64_MAX) {
+    event_loop_cancel_timer(loop, handler->update_timer);
+    handler->update_timer = 0;
+  } else if (!event_loop_reschedule_timer(loop, handler->update_timer,
+                                          next_deadline)) {
+    handler->update_timer =
+        event_loop_add_timer(loop, next_deadline, on_update_due, handler);
+  }
+
+  if (xcb_connection_has_error(handler->conn)) {
+    LOG("X11 connection error detected, exiting loop");
+    return true;
+  }
+  return false;
+}
+
+void input_handler_run(InputHandler *handler) {
+  if (!handler)
+    return;
+  while (!input_handler_dispatch(handler, -1))
+    ;
 }
 
 bool input_handler_process_event(InputHandler *handler) {
   if (!handler)
     return false;
-  xcb_generic_event_t *event = xcb_poll_for_event(handler->conn);
+  xcb_generic_event_t *event = handler->focus_ctx
+                                   ? x11_focus_poll_event(handler->focus_ctx)
+                                   : xcb_poll_for_event(handler->conn);
   if (!event)
     return false;
 
@@ -387,6 +538,26 @@ bool input_handler_process_event(InputHandler *handler) {
   return result;
 }
 
+// Switches the active menu. In daemon mode this is where the keyboard is
+// actively grabbed; the trigger key arrived through a passive grab.
+static void input_handler_open_menu(InputHandler *handler, Menu *menu) {
+  x11_op_enter(X11_OP_ACTIVATE);
+  if (handler->menu_manager->active_menu) {
+    menu_manager_deactivate(handler->menu_manager);
+  }
+  if (handler->daemon_mode && !handler->grab_active) {
+    handler->grab_active =
+        x11_grab_inputs_once(handler->focus_ctx, *handler->root);
+  }
+  if (!menu_cairo_is_setup(menu) &&
+      !cairo_menu_pool_attach(handler->menu_pool, menu)) {
+    menu_setup_cairo(handler->conn, *handler->root, handler->focus_ctx,
+                     handler->screen, menu);
+  }
+  menu_manager_activate(handler->menu_manager, menu);
+  x11_op_leave();
+}
+
 bool input_handler_handle_event(InputHandler *handler,
                                 xcb_generic_event_t *event) {
   if (!handler || !event)
@@ -417,14 +588,7 @@ bool input_handler_handle_event(InputHandler *handler,
             menu_to_activate->config.title,
             (handler->menu_manager->active_menu == menu_to_activate));
         if (handler->menu_manager->active_menu != menu_to_activate) {
-          if (handler->menu_manager->active_menu) {
-            menu_manager_deactivate(handler->menu_manager);
-          }
-          if (!menu_cairo_is_setup(menu_to_activate)) {
-            menu_setup_cairo(handler->conn, *handler->root, handler->focus_ctx,
-                             handler->screen, menu_to_activate);
-          }
-          menu_manager_activate(handler->menu_manager, menu_to_activate);
+          input_handler_open_menu(handler, menu_to_activate);
           return false;
         } else {
           return menu_handle_key_press(handler->menu_manager->active_menu, kp);
@@ -446,14 +610,7 @@ bool input_handler_handle_event(InputHandler *handler,
           input_handler_handle_activation(handler, kp->state, kp->detail);
       if (menu_to_activate) {
         if (handler->menu_manager->active_menu != menu_to_activate) {
-          if (handler->menu_manager->active_menu) {
-            menu_manager_deactivate(handler->menu_manager);
-          }
-          if (!menu_cairo_is_setup(menu_to_activate)) {
-            menu_setup_cairo(handler->conn, *handler->root, handler->focus_ctx,
-                             handler->screen, menu_to_activate);
-          }
-          menu_manager_activate(handler->menu_manager, menu_to_activate);
+          input_handler_open_menu(handler, menu_to_activate);
         }
       }
       return false;
@@ -487,7 +644,18 @@ bool input_handler_handle_event(InputHandler *handler,
     LOG("[IH-RELEASE] FINALIZING,exit=%d", false);
     return false;
   }
+  case XCB_PROPERTY_NOTIFY:
+    x11_focus_handle_event(handler->focus_ctx, event);
+    window_list_handle_event(handler->window_list, handler->conn,
+                             handler->ewmh, event);
+    return false;
+  case XCB_CONFIGURE_NOTIFY:
+  case XCB_DESTROY_NOTIFY:
+    x11_focus_handle_event(handler->focus_ctx, event);
+    return false;
   default:
+    // ShmCompletion carries an extension event code
+    menu_manager_foreach(handler->menu_manager, route_upload_completion, event);
     LOG("Unhandled event type: 0x%x", type);
     return false;
   }
@@ -503,6 +671,11 @@ Menu *input_handler_add_menu(InputHandler *handler, Menu *menu) {
 
   // Register the provided menu with the manager
   if (menu_manager_register(handler->menu_manager, menu)) {
+    cairo_menu_pool_reserve(handler->menu_pool, menu);
+    if (handler->daemon_mode && handler->focus_ctx) {
+      x11_grab_key(handler->focus_ctx, menu->config.mod_key,
+                   menu->config.trigger_key);
+    }
     return menu; // Return the menu if registration is successful
   } else {
     LOG("[ERROR] Failed to register menu: [%s]", menu->config.title);
@@ -512,6 +685,34 @@ Menu *input_handler_add_menu(InputHandler *handler, Menu *menu) {
   // to the menu_manager upon successful registration.
 }
 
+bool input_handler_watch_windows(InputHandler *handler, WindowList *list) {
+  if (!handler || !handler->conn || !list)
+    return false;
+  if (!window_list_watch(list, handler->conn, handler->ewmh, *handler->root))
+    return false;
+  handler->window_list = list;
+  // Leaves the list's events selected on a window that stops being active
+  if (handler->focus_ctx)
+    handler->focus_ctx->active.client_mask = X11_CLIENT_EVENT_MASK;
+  return true;
+}
+
+bool input_handler_grab_triggers(InputHandler *handler) {
+  if (!handler || !handler->focus_ctx)
+    return false;
+  x11_ungrab_keys(handler->focus_ctx);
+  bool ok = true;
+  for (size_t i = 0; i < menu_manager_get_menu_count(handler->menu_manager);
+       i++) {
+    Menu *menu = menu_manager_menu_index(handler->menu_manager, i);
+    LOG("[GRAB] Passive grab mod=0x%x key=%u [%s]", menu->config.mod_key,
+        menu->config.trigger_key, menu->config.title);
+    ok &= x11_grab_key(handler->focus_ctx, menu->config.mod_key,
+                       menu->config.trigger_key);
+  }
+  return ok;
+}
+
 // TODO any use?
 /* bool input_handler_remove_menu(InputHandler *handler, Menu *menu) { */
 /*   if (!handler || !menu) */
@@ -527,7 +728,8 @@ Menu *input_handler_handle_activation(InputHandler *handler, uint16_t mod_key,
     Menu *menu = menu_manager_menu_index(handler->menu_manager, i);
     LOG("Checking activation state: mod_key=0x%x, keycode=%u", mod_key,
         keycode);
-    if (menu->config.mod_key == mod_key &&
+    // Passive grabs also fire with Caps/Num Lock held; ignore those bits.
+    if (menu->config.mod_key == (mod_key & ~X11_LOCK_MASKS) &&
         menu->config.trigger_key == keycode) {
       LOG("[%s] Activation state matched: mod_key=0x%x, keycode=%u",
           menu->config.title, menu->config.mod_key, menu->config.trigger_key);
@@ -3,8 +3,11 @@
 #define INPUT_HANDLER_H
 
 #include <stdbool.h> // For bool type
+#include "cairo_menu.h"
+#include "event_loop.h"
 #include "menu_manager.h"
 #include "x11_focus.h"
+#include "x11_window.h"
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
 
@@ -18,6 +21,13 @@ typedef struct {
   MenuManager *menu_manager;
   ActivationState *activation_states;
   size_t activation_state_count;
+  bool daemon_mode; // Stay resident after a menu closes instead of exiting
+  bool grab_active; // Daemon mode: active keyboard grab held for a menu
+  WindowList *window_list; // Live window index fed from PropertyNotify
+  CairoMenuPool *menu_pool; // Render targets shared by all menus
+  EventLoop *loop;          // Created on first dispatch, see below
+  EventLoopTimer update_timer; // Next menu update or animation frame
+  bool input_pending; // A burst was cut short; events may still be queued
 } InputHandler;
 
 /* Initialize input handler with menu manager */
@@ -30,6 +40,13 @@ void input_handler_destroy(InputHandler *handler);
 bool input_handler_process_event(InputHandler *handler);
 
 Menu *input_handler_add_menu(InputHandler *handler, Menu *menu);
+
+/* Daemon mode: (re)register passive grabs for the mod_key + trigger_key of
+ * every registered menu */
+bool input_handler_grab_triggers(InputHandler *handler);
+/* Keep list current from X events (see window_list_watch); the handler
+ * does not take ownership */
+bool input_handler_watch_windows(InputHandler *handler, WindowList *list);
 /* bool input_handler_remove_menu(InputHandler *handler, Menu *menu); */
 
 /* Add activation state */
@@ -38,8 +55,20 @@ Menu *input_handler_add_menu(InputHandler *handler, Menu *menu);
 Menu *input_handler_handle_activation(InputHandler *handler, uint16_t mod_key,
                                       uint8_t keycode);
 
-/* Run the main event loop */
+/* Run the main event loop.
+ * Returns after the first completed menu interaction unless
+ * handler->daemon_mode is set, in which case it only returns when the X
+ * connection breaks. */
 void input_handler_run(InputHandler *handler);
+/* One iteration of input_handler_run: waits up to timeout_ms (-1: until X
+ * input or the next update/animation deadline), handles pending events and
+ * runs due menu updates. Returns true when the loop should stop.
+ *
+ * To embed the handler in another main loop, watch
+ * event_loop_get_fd(input_handler_get_loop(handler)) (readable when input
+ * or a deadline is due) and call input_handler_dispatch(handler, 0). */
+bool input_handler_dispatch(InputHandler *handler, int timeout_ms);
+EventLoop *input_handler_get_loop(InputHandler *handler);
 bool input_handler_handle_event(InputHandler *handler,
                                 xcb_generic_event_t *event);
 
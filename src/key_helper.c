@@ -1,4 +1,5 @@
 #include "key_helper.h"
+#include "x11_stats.h"
 #include <stdlib.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
@@ -66,7 +67,8 @@ uint16_t mod_state(xcb_connection_t *conn) {
   uint16_t state = 0;
 
   xcb_query_keymap_cookie_t cookie = xcb_query_keymap(conn);
-  xcb_query_keymap_reply_t *reply = xcb_query_keymap_reply(conn, cookie, NULL);
+  xcb_query_keymap_reply_t *reply =
+      X11_SYNC(xcb_query_keymap_reply(conn, cookie, NULL));
   if (!reply) {
     // Error occurred; return empty state (0)
     return 0;
@@ -1,42 +1,40 @@
 // ====================== FILE: main.c (safe minimal example) ==================
+#include "frame_clock.h"
 #include "input_handler.h"
 #include "key_helper.h"
 #include "menu_builder.h"
 #include "version.h"
 #include "window_menu.h"
 #include "x11_window.h"
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <xcb/xcb.h>
 #ifdef MENU_DEBUG
 #define LOG_PREFIX "[MAIN]"
 #endif
 #include "log.h"
 
-static MenuConfig *rebuild_menu_config(WindowMenu *wm, uint16_t mod_key,
-                                       uint8_t trigger_key) {
-
-  MenuBuilder builder =
-      menu_builder_create(wm->menu->config.title, wm->window_list->count);
-  for (size_t i = 0; i < wm->window_list->count; i++) {
-    xcb_window_t *win_ptr = malloc(sizeof(xcb_window_t));
-    if (!win_ptr) {
-      fprintf(stderr, "Failed to allocate memory for window id\n");
-      exit(EXIT_FAILURE);
-    }
-    *win_ptr = wm->window_list->windows[i].id;
-    menu_builder_add_item(&builder, wm->window_list->windows[i].title, NULL,
-                          win_ptr);
+// Builds a window menu over the shared window list and registers it with the
+// handler. The filter data must outlive the menu: in daemon mode the menu
+// re-applies it to the refreshed list on every activation.
+static WindowMenu *add_window_menu(InputHandler *handler, WindowList *all,
+                                   const SubstringsFilterData *filter_data,
+                                   uint8_t trigger_key, char *title) {
+  WindowList *filtered =
+      window_list_filter(all, window_filter_substrings_any, filter_data);
+  WindowMenu *wm = window_menu_create(handler->conn, filtered, SUPER_MASK,
+                                      trigger_key, handler->ewmh, title);
+  window_menu_set_filter(wm, all, window_filter_substrings_any, filter_data);
+  if (handler->daemon_mode)
+    window_menu_enable_refresh(wm);
+  if (!input_handler_add_menu(handler, wm->menu)) {
+    fprintf(stderr, "Failed to register menu (Super+%u)\n", trigger_key);
   }
-
-  menu_builder_set_trigger_key(&builder, trigger_key);
-  menu_builder_set_mod_key(&builder, mod_key);
-  menu_builder_set_navigation_keys(&builder, 44, "j", 45, "k", NULL,
-                                   0); // j, k
-  menu_builder_set_activation(&builder, true, true);
-  MenuConfig *config = menu_builder_finalize(&builder);
-  menu_builder_destroy(&builder);
-  return config;
+  return wm;
 }
+
 // Removed redundant rebuild_menu_config function.
 // window_menu_create handles config creation internally.
 /* static MenuConfig build_menu_config(WindowMenu *wm, uint16_t modifier_mask) {
@@ -95,14 +93,20 @@ int main(int argc, char *argv[]) {
     printf("argv[%d]: %s\n", i, argv[i]);
   }
 
+  bool daemon_mode = false;
   uint8_t keycode = 0;
-  if (argc == 2) {
-    keycode = atoi(argv[1]);
-  }
-
-  if (argc > 2) {
-    printf("Usage: %s <KEYCODE>\n", argv[0]);
-    return EXIT_FAILURE;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--daemon") == 0) {
+      daemon_mode = true;
+    } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc &&
+               atoi(argv[i + 1]) > 0) {
+      frame_clock_set_rate(frame_clock_shared(), atoi(argv[++i]));
+    } else if (keycode == 0 && atoi(argv[i]) > 0) {
+      keycode = atoi(argv[i]);
+    } else {
+      printf("Usage: %s [--daemon] [--fps <HZ>] [<KEYCODE>]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
   }
 
   InputHandler *handler = input_handler_create();
@@ -110,6 +114,7 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "[MAIN] Failed to create input handler\n");
     return EXIT_FAILURE;
   }
+  handler->daemon_mode = daemon_mode;
   if (!input_handler_setup_x(handler)) {
     fprintf(stderr, "[MAIN] Failed to setup X for input handler. Exiting.\n");
     input_handler_destroy(handler); // Cleanup handler resources
@@ -119,65 +124,21 @@ int main(int argc, char *argv[]) {
 
   xcb_connection_t *conn = handler->conn;
   WindowList *window_list = window_list_init(conn, handler->ewmh);
+  // Resident: follow window changes as they happen so opening a menu needs
+  // no round-trips at all.
+  if (daemon_mode && !input_handler_watch_windows(handler, window_list))
+    fprintf(stderr, "[MAIN] Failed to watch window changes\n");
 
-  SubstringsFilterData sub_data =
+  // Filter data lives for the whole run; resident menus re-filter with it.
+  SubstringsFilterData browser_filter =
       substrings_filter_data((const char *[]){"Chrom", "Firefox"}, 2);
-  /* SubstringFilterData sub_data = substring_filter_data("macs"); */
-  WindowList *window_list_f =
-      window_list_filter(window_list, window_filter_substrings_any, &sub_data);
-  WindowMenu *window_menu = window_menu_create(conn, window_list_f, SUPER_MASK,
-                                               31, handler->ewmh, "Browser");
-  // rebuild_menu_config now returns a pointer to an allocated config
-  MenuConfig *window_menu_config_ptr =
-      rebuild_menu_config(window_menu, SUPER_MASK, 31);
-  Menu *menu_obj = menu_create(window_menu_config_ptr); // Pass the pointer
-  if (menu_obj) {
-    input_handler_add_menu(handler, menu_obj); // Add the menu object
-    menu_obj->on_select =
-        window_menu_on_select; // Set callback on the created menu
-  } else {
-    fprintf(stderr, "Failed to create menu from config (Super+31)\n");
-    // Handle error
-  }
-  // Free the config struct itself after menu_create is done with it
-  // (menu_create handles freeing the items array/strings within the config)
-  menu_config_destroy(window_menu_config_ptr);
-
-  sub_data = substrings_filter_data((const char *[]){"macs", "Visual"}, 2);
-  /* SubstringFilterData sub_data = substring_filter_data("macs"); */
-  window_list_f =
-      window_list_filter(window_list, window_filter_substrings_any, &sub_data);
-  window_menu = window_menu_create(conn, window_list_f, SUPER_MASK, 30,
-                                   handler->ewmh, "Code");
-  window_menu_config_ptr = rebuild_menu_config(window_menu, SUPER_MASK, 30);
-  menu_obj = menu_create(window_menu_config_ptr); // Pass the pointer
-  if (menu_obj) {
-    input_handler_add_menu(handler, menu_obj); // Add the menu object
-    menu_obj->on_select =
-        window_menu_on_select; // Set callback on the created menu
-  } else {
-    fprintf(stderr, "Failed to create menu from config (Super+30)\n");
-    // Handle error
-  }
-  menu_config_destroy(window_menu_config_ptr); // Free the config struct
-
-  sub_data = substrings_filter_data((const char *[]){"tmux", "kitty"}, 2);
-  /* SubstringFilterData sub_data = substring_filter_data("macs"); */
-  window_list_f =
-      window_list_filter(window_list, window_filter_substrings_any, &sub_data);
-  window_menu = window_menu_create(conn, window_list_f, SUPER_MASK, 32,
-                                   handler->ewmh, "Terminal");
-  window_menu_config_ptr = rebuild_menu_config(window_menu, SUPER_MASK, 32);
-  menu_obj = menu_create(window_menu_config_ptr); // Pass the pointer
-  if (menu_obj) {
-    input_handler_add_menu(handler, menu_obj); // Add the menu object
-    menu_obj->on_select =
-        window_menu_on_select; // Set callback on the created menu
-  } else {
-    fprintf(stderr, "Failed to create menu from config (Super+32)\n");
-    // Handle error
-  }
-  menu_config_destroy(window_menu_config_ptr); // Free the config struct
+  SubstringsFilterData code_filter =
+      substrings_filter_data((const char *[]){"macs", "Visual"}, 2);
+  SubstringsFilterData terminal_filter =
+      substrings_filter_data((const char *[]){"tmux", "kitty"}, 2);
+  add_window_menu(handler, window_list, &browser_filter, 31, "Browser");
+  add_window_menu(handler, window_list, &code_filter, 30, "Code");
+  add_window_menu(handler, window_list, &terminal_filter, 32, "Terminal");
 
   if (xcb_connection_has_error(conn)) {
     fprintf(stderr, "Cannot connect to X server\n");
@@ -191,7 +152,10 @@ int main(int argc, char *argv[]) {
     LOG("injecting release code: %d state: %d", keycode, state);
     input_handler_handle_event(handler, &event);
   }
-  // Run the input handler event loop
+  // Run the input handler event loop (returns after one selection unless
+  // running as a daemon)
+  if (daemon_mode)
+    printf("Running as daemon, menus stay resident\n");
   input_handler_run(handler);
 
   // Cleanup (after exit)
@@ -4,10 +4,13 @@
 #include "cairo_menu.h"
 #include "cairo_menu_animation.h"
 #include "cairo_menu_render.h"
+#include "frame_clock.h"
 #include "menu_animation.h"
+#include "x11_stats.h"
 #include "x11_window.h"
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <xcb/xcb.h>
 
 #ifdef MENU_DEBUG
@@ -15,6 +18,9 @@
 #endif
 #include "log.h"
 
+static void menu_queue_selection(Menu *menu);
+static void menu_drop_selection(Menu *menu);
+
 Menu *menu_create(MenuConfig *config) {
     if (!config) return NULL;
 
@@ -148,7 +154,11 @@ void menu_show(Menu *menu) {
     LOG("No user data found");
     return;
   }
-  cairo_menu_animation_init(data);
+  x11_op_enter(X11_OP_SHOW);
+  // Resident menus are shown many times; keep the animations created by
+  // menu_setup_cairo instead of allocating a new pair on every show.
+  if (!data->anim.show_animation && !data->anim.hide_animation)
+    cairo_menu_animation_init(data);
   /* LOG("Animations initialized successfully\n"); */
   /* menu_set_update_interval(menu, 20); */
   /* cairo_menu_animation_set_default(data, MENU_ANIM_FADE, MENU_ANIM_FADE, */
@@ -178,7 +188,9 @@ void menu_show(Menu *menu) {
   /* } */
   /* if (menu->update_interval > 0 && menu->update_cb) */
   /*   menu_trigger_update(menu); */
+  menu_drop_selection(menu);
   menu_trigger_on_select(menu);
+  x11_op_leave();
 }
 
 void menu_hide(Menu *menu) {
@@ -186,6 +198,8 @@ void menu_hide(Menu *menu) {
   /*   return; */
   menu->active = false;
   menu->state = MENU_STATE_INACTIVE;
+  // The final selection still takes effect, without painting
+  menu_flush_selection(menu);
   /* menu->selected_index = 0; */
   if (menu_cairo_is_setup(menu)) {
     cairo_menu_deactivate(menu);
@@ -238,15 +252,18 @@ void menu_cancel(Menu *menu) {
   menu->active = false;
   menu->state = MENU_STATE_INACTIVE;
   menu->selected_index = 0;
+  menu_drop_selection(menu); // The previewed selection is not applied
   xcb_window_t win = menu->focus_ctx->previous_focus;
   if (win) {
-    window_activate(menu->focus_ctx->conn, win);
-    switch_to_window(menu->focus_ctx->conn, win);
+    // Desktop unknown here; the window manager switches for the activation
+    window_activate_cached(menu->focus_ctx->conn, menu->focus_ctx->ewmh, win,
+                           X11_DESKTOP_ALL);
   }
   /* cairo_menu_hide(menu); */
 }
 
 void menu_confirm_selection(Menu *menu) {
+  menu_flush_selection(menu);
   MenuItem *item = menu_get_selected_item(menu);
   if (item && item->action) {
 
@@ -271,6 +288,8 @@ void menu_confirm_selection(Menu *menu) {
 void menu_destroy(Menu *menu) {
     if (!menu) return;
 
+    menu_drop_selection(menu);
+
     // 1. Call user-provided cleanup callback first (if any)
     // This callback might free menu->user_data or other resources associated with it.
     if (menu->cleanup_cb) {
@@ -337,8 +356,13 @@ void menu_select_index(Menu *menu, int index) {
   if (!menu || menu->config.item_count == 0 || index < 0 ||
       (size_t)index >= menu->config.item_count || menu->selected_index == index)
     return;
+  // Only the old and the new highlighted row change
+  if (menu->user_data) {
+    cairo_menu_render_damage_row(menu->user_data, menu->selected_index);
+    cairo_menu_render_damage_row(menu->user_data, index);
+  }
   menu->selected_index = index;
-  menu_trigger_on_select(menu);
+  menu_queue_selection(menu);
   LOG("Selected index: %d", menu->selected_index);
 }
 
@@ -359,8 +383,16 @@ void menu_set_update_callback(Menu *menu, void (*cb)(Menu *, void *)) {
 }
 
 void menu_trigger_update(Menu *menu) {
-  if (menu && menu->update_cb)
+  if (menu && menu->update_cb) {
     menu->update_cb(menu, menu->user_data);
+    // Updating the labels is what update callbacks are for
+    menu_text_changed(menu);
+  }
+}
+
+void menu_text_changed(Menu *menu) {
+  if (menu)
+    menu->text_generation++;
 }
 
 void menu_redraw(Menu *menu) {
@@ -373,6 +405,43 @@ void menu_redraw(Menu *menu) {
   }
 }
 
+// Only the highlight moved: repaint the damaged rows in place instead of
+// menu_redraw, which would also map, re-place and resize the window.
+static void menu_paint_selection(Menu *menu) {
+  if (menu->active && menu->user_data)
+    cairo_menu_render_repaint(menu->user_data);
+}
+
+void menu_flush_selection(Menu *menu) {
+  if (!menu || !menu->selection_pending)
+    return;
+  menu_drop_selection(menu);
+  menu_trigger_on_select(menu);
+}
+
+// One frame clock tick: the selection the burst of moves ended on
+static bool menu_selection_frame(void *user_data, double delta_ms) {
+  (void)delta_ms;
+  menu_flush_selection(user_data);
+  return false; // Registered again by the next change
+}
+
+static void menu_queue_selection(Menu *menu) {
+  if (!menu->selection_pending)
+    menu->selection_pending =
+        frame_clock_add(frame_clock_shared(), menu_selection_frame, menu);
+  // Without a free animator slot it takes effect right away
+  if (!menu->selection_pending)
+    menu_trigger_on_select(menu);
+}
+
+static void menu_drop_selection(Menu *menu) {
+  if (!menu->selection_pending)
+    return;
+  menu->selection_pending = false;
+  frame_clock_remove(frame_clock_shared(), menu);
+}
+
 void menu_set_on_select_callback(Menu *menu,
                                  void (*on_select)(MenuItem *item,
                                                    void *user_data)) {
@@ -388,10 +457,12 @@ void menu_trigger_on_select(Menu *menu) {
   if (menu && menu->on_select) {
     // Item already fetched above
     LOG("Triggering with item %p and data %p", item, menu->user_data);
+    x11_op_enter(X11_OP_SELECT);
     if (item) {
       menu->on_select(item, menu->user_data);
     }
     LOG("DONE Triggering with item %p and data %p", item, menu->user_data);
-    menu_redraw(menu);
+    menu_paint_selection(menu);
+    x11_op_leave();
   }
 }
@@ -113,6 +113,8 @@ struct Menu {
   MenuState state;
   bool active;        // Is the menu active?(the menu receiving key events)
   int selected_index; // Index of the selected item
+  bool selection_pending; // on_select and repaint held for the next frame
+  unsigned long text_generation; // Bumped by menu_text_changed
 
   void *user_data; // User data pointer - can be used to store custom data
   X11FocusContext *focus_ctx; // X11 focus context - gets passed along the
@@ -154,7 +156,15 @@ MenuState menu_get_state(Menu *menu);
 void menu_set_update_interval(Menu *menu, unsigned int ms);
 void menu_set_update_callback(Menu *menu, void (*cb)(Menu *, void *));
 void menu_trigger_update(Menu *menu);
+/* The title, a label or the font face was replaced or edited in place; the
+ * menu is measured again before the next paint. Update callbacks run by
+ * menu_trigger_update need not call it. */
+void menu_text_changed(Menu *menu);
 void menu_redraw(Menu *menu);
+/* Selection changes only record damage; on_select and the repaint run once
+ * per frame of the shared frame clock, for the final selection. Flushing
+ * runs them right away (hiding and confirming a menu do). */
+void menu_flush_selection(Menu *menu);
 bool menu_cairo_is_setup(Menu *menu);
 void menu_confirm_selection(Menu *menu);
 void menu_trigger_on_select(Menu *menu);
@@ -3,10 +3,12 @@
 #include "cairo_menu.h"
 #include "cairo_menu_animation.h"
 #include "cairo_menu_render.h"
+#include "event_loop.h"
+#include "frame_clock.h"
+#include "x11_stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <unistd.h>
 
 #ifdef MENU_DEBUG
@@ -17,7 +19,7 @@
 /* Registry entry */
 typedef struct MenuRegistryEntry {
   Menu *menu;
-  struct timeval last_update;
+  uint64_t last_update; /* event_loop_now_ms() of the last update */
   struct MenuRegistryEntry *next;
 } MenuRegistryEntry;
 
@@ -54,7 +56,7 @@ static Menu *registry_find_by_id(MenuRegistryEntry *entry, const char *id) {
  * Usage:
  * menu_manager_foreach(manager, callback_fn, user_data);
  * Example callback_fn:
- * bool callback_fn(Menu *menu, struct timeval *last_update, void *user_data) {
+ * bool callback_fn(Menu *menu, uint64_t *last_update, void *user_data) {
  *  // Do something with menu, e.g. match ev->state + ev->detail
  * if (menu->mod_key == ev->state && menu->trigger_key == ev->detail) {
  *   menu_manager_activate(manager, menu);
@@ -138,7 +140,7 @@ bool menu_manager_register(MenuManager *mgr, Menu *menu) {
   }
 
   entry->menu = menu;
-  gettimeofday(&entry->last_update, NULL);
+  entry->last_update = event_loop_now_ms();
   entry->next = head;
   mgr->registry = entry;
   mgr->menu_count++;
@@ -186,10 +188,15 @@ bool menu_manager_activate(MenuManager *mgr, Menu *menu) {
       registry_find((MenuRegistryEntry *)mgr->registry, menu);
   if (entry) {
     LOG("Updating last update time for menu: %s", menu->config.title);
-    gettimeofday(&entry->last_update, NULL);
+    entry->last_update = event_loop_now_ms();
   } else {
     LOG("Failed to update last update time for menu: %s", menu->config.title);
   }
+  // Give the menu a chance to refresh its items before it is shown
+  // (e.g. window menus kept resident in daemon mode).
+  if (menu->config.act.custom_activate) {
+    menu->config.act.custom_activate(menu, menu->config.act.user_data);
+  }
   LOG("Activating->Showing menu: %s", menu->config.title);
   menu_show(menu);
   LOG("Activated menu: %s", menu->config.title);
@@ -226,11 +233,11 @@ Menu *menu_manager_find_menu(MenuManager *mgr, const char *id) {
 char *menu_manager_status_string(MenuManager *mgr) {
   if (!mgr)
     return NULL;
-  char *buffer = calloc(1, 1024);
+  char *buffer = calloc(1, MENU_STATUS_SIZE);
   if (!buffer)
     return NULL;
 
-  snprintf(buffer, 1024, "Active: %s\nCount: %zu\n",
+  snprintf(buffer, MENU_STATUS_SIZE, "Active: %s\nCount: %zu\n",
            mgr->active_menu ? mgr->active_menu->config.title : "None",
            mgr->menu_count);
 
@@ -242,6 +249,21 @@ char *menu_manager_status_string(MenuManager *mgr) {
     entry = entry->next;
   }
 
+  if (mgr->focus_ctx) {
+    size_t len = strlen(buffer);
+    x11_grab_stats_format(x11_focus_get_grab_stats(mgr->focus_ctx),
+                          buffer + len, MENU_STATUS_SIZE - len);
+  }
+
+  // Round-trips per operation (setup, refresh, show, select, activate)
+  size_t len = strlen(buffer);
+  x11_op_stats_format(buffer + len, MENU_STATUS_SIZE - len);
+
+  // Animation pacing
+  len = strlen(buffer);
+  frame_clock_stats_format(frame_clock_shared(), buffer + len,
+                           MENU_STATUS_SIZE - len);
+
   return buffer;
 }
 
@@ -6,7 +6,7 @@
 #include "menu.h"
 #include "x11_focus.h"
 #include <stdbool.h>
-#include <sys/time.h>
+#include <stdint.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
 
@@ -42,14 +42,18 @@ Menu *menu_manager_get_active(MenuManager *manager);
 
 size_t menu_manager_get_menu_count(MenuManager *manager);
 Menu *menu_manager_find_menu(MenuManager *manager, const char *id);
+/* Status text: menus, grab stats and per-operation round-trips */
+#define MENU_STATUS_SIZE 2048
 char *menu_manager_status_string(MenuManager *manager); // caller must free
 
 /* Registry iteration (internalized access) */
-typedef bool (*MenuManagerForEachFn)(Menu *menu, struct timeval *last_update,
+/* last_update is a monotonic timestamp in ms (see event_loop_now_ms) */
+typedef bool (*MenuManagerForEachFn)(Menu *menu, uint64_t *last_update,
                                      void *user_data);
 /* Iterate over all menus in the manager
  * Usage: menu_manager_foreach(manager, fn, user_data)
- * fn: MenuManagerForEachFn - callback function accepting Menu, timeval, void*
+ * fn: MenuManagerForEachFn - callback function accepting Menu, last update,
+ *     void*
  *     - return false to stop iteration
  * user_data user_data: void* - user data to pass to callback
  *
@@ -57,7 +61,7 @@ typedef bool (*MenuManagerForEachFn)(Menu *menu, struct timeval *last_update,
  *
  * Example: find matching mod_key + keycode:
  * pass ev from key press event and match mod_key + keycode
- * bool fn(Menu *menu, struct timeval *last_update, void *user_data) {
+ * bool fn(Menu *menu, uint64_t *last_update, void *user_data) {
     *   xcb_key_press_event_t *ev = (xcb_key_press_event_t *)user_data;
 
     *   if (menu->mod_key == ev->state && menu->trigger_key == ev->detail) {
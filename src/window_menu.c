@@ -15,20 +15,38 @@
 #endif
 #include "log.h"
 
+// Looks up the window list entry behind a menu item
+static const X11Window *window_menu_find(WindowMenu *wm, MenuItem *item,
+                                         xcb_window_t win) {
+  WindowList *list = wm->window_list;
+  size_t index = (size_t)(item - wm->menu->config.items);
+  if (index < list->count && list->windows[index].id == win)
+    return &list->windows[index];
+  for (size_t i = 0; i < list->count; i++) {
+    if (list->windows[i].id == win)
+      return &list->windows[i];
+  }
+  return NULL;
+}
+
 // Helper: on-select callback for the menu.
 // When an item is selected, this callback is invoked to activate the
 // corresponding window.
 void window_menu_on_select(MenuItem *item, void *user_data) {
-  WindowMenu *wm = (WindowMenu *)user_data;
+  // Once menu_setup_cairo ran, menu->user_data is the CairoMenuData; the
+  // WindowMenu itself travels in the activation config (see
+  // window_menu_create).
+  CairoMenuData *data = (CairoMenuData *)user_data;
+  WindowMenu *wm = data && data->menu ? data->menu->config.act.user_data : NULL;
   if (wm && item && item->metadata) {
     // metadata is stored as a pointer to xcb_window_t
     xcb_window_t win = *((xcb_window_t *)item->metadata);
-    // Activate the window (function assumed to be provided elsewhere)
-    /* focus_window(wm->conn, *wm->menu->focus_ctx->ewmh, win); */
-    uint32_t desktop = window_get_desktop(wm->conn, win);
+    // Items are built in window_list order; the list entry carries the
+    // desktop, so activation needs no round-trip.
+    const X11Window *entry = window_menu_find(wm, item, win);
+    uint32_t desktop = entry ? entry->desktop : X11_DESKTOP_ALL;
     LOG("OnSelect Window: %u, desktop: %u", win, desktop);
-    window_activate(wm->conn, win);
-    switch_to_window(wm->conn, win);
+    window_activate_cached(wm->conn, wm->ewmh, win, desktop);
     /* CairoMenuData *data = (CairoMenuData *)wm->menu->user_data; */
     /* cairo_menu_render_request_update(data); */
     /* menu_hide(wm->menu); */
@@ -36,6 +54,17 @@ void window_menu_on_select(MenuItem *item, void *user_data) {
   }
 }
 
+// Activation hook (ActivationConfig.custom_activate): a resident menu
+// re-reads the window list right before it is shown.
+static void window_menu_on_activate(Menu *menu, void *user_data) {
+  WindowMenu *wm = (WindowMenu *)user_data;
+  if (!wm)
+    return;
+  LOG("Refreshing windows for [%s]", menu->config.title);
+  window_menu_update_windows(wm);
+  menu->selected_index = 0;
+}
+
 // Helper: Builds a *new* MenuConfig from the current WindowList.
 // Returns a pointer to a newly allocated MenuConfig.
 // Caller is responsible for freeing it using menu_config_destroy().
@@ -119,8 +148,9 @@ WindowMenu *window_menu_create(xcb_connection_t *conn, WindowList *window_list,
   // Set the on-select callback so that any selection activates the window.
   menu_set_on_select_callback(wm->menu, window_menu_on_select);
   wm->menu->on_select = window_menu_on_select;
-  // Ensure the WindowMenu pointer is available in the menu’s user_data.
-  wm->menu->user_data = wm;
+  // menu->user_data is taken over by the Cairo backend, so the WindowMenu
+  // pointer is kept in the activation config instead.
+  wm->menu->config.act.user_data = wm;
 
   return wm;
 }
@@ -135,10 +165,47 @@ xcb_window_t window_menu_get_selected(WindowMenu *wm) {
   return XCB_NONE;
 }
 
+void window_menu_set_filter(WindowMenu *wm, WindowList *source,
+                            WindowFilterFn filter, const void *filter_data) {
+  if (!wm)
+    return;
+  wm->source = source;
+  wm->filter = filter;
+  wm->filter_data = filter_data;
+  // The items were built from a filtered copy of source as it is now
+  wm->source_version = source ? source->version : 0;
+}
+
+void window_menu_enable_refresh(WindowMenu *wm) {
+  if (!wm || !wm->menu)
+    return;
+  wm->menu->config.act.custom_activate = window_menu_on_activate;
+  wm->menu->config.act.user_data = wm;
+}
+
 void window_menu_update_windows(WindowMenu *wm) {
   if (wm && wm->menu && wm->window_list) {
-    // Update the window list (function provided elsewhere).
-    window_list_update(wm->window_list, wm->conn, wm->ewmh); // Pass stored ewmh
+    if (wm->source && wm->filter) {
+      if (wm->source->live) {
+        // Kept current by PropertyNotify events: nothing to fetch, and
+        // nothing to rebuild unless it changed since the last build.
+        if (wm->source_version == wm->source->version)
+          return;
+      } else {
+        // Refresh the shared list and re-derive our filtered view from it.
+        window_list_update(wm->source, wm->conn, wm->ewmh);
+      }
+      wm->source_version = wm->source->version;
+      WindowList *filtered =
+          window_list_filter(wm->source, wm->filter, wm->filter_data);
+      if (filtered) {
+        window_list_free(wm->window_list);
+        wm->window_list = filtered;
+      }
+    } else {
+      // Update the window list (function provided elsewhere).
+      window_list_update(wm->window_list, wm->conn, wm->ewmh);
+    }
 
     // Free old menu item strings (id, label) and metadata before freeing the
     // items array itself. Assumes id and label were previously allocated (e.g.,
@@ -235,8 +302,11 @@ void window_menu_update_windows(WindowMenu *wm) {
       }
     }
 
-    // Trigger a redraw of the menu.
-    menu_redraw(wm->menu);
+    menu_text_changed(wm->menu);
+    // Trigger a redraw of the menu. A resident menu refreshed while hidden
+    // must not map its window here; menu_show paints it when it opens.
+    if (wm->menu->active)
+      menu_redraw(wm->menu);
   }
 }
 
@@ -15,6 +15,10 @@ typedef struct {
   Menu *menu;                  // Pointer to the created Menu from menu.h API
   WindowList *window_list;     // Pointer to our window list
   xcb_ewmh_connection_t *ewmh; // Pointer to the EWMH connection info
+  WindowList *source;          // Unfiltered list shared between menus (or NULL)
+  WindowFilterFn filter;       // Filter applied to source on refresh
+  const void *filter_data;     // Data for filter (must outlive the menu)
+  unsigned long source_version; // source->version the items were built from
 } WindowMenu;
 
 // Creates a window menu using the working menu.h API.
@@ -28,8 +32,18 @@ xcb_window_t window_menu_get_selected(WindowMenu *wm);
 
 // Updates the menu items from the latest window list.
 // (For example, after window_list_update() is called.)
+// With a live source list (window_list_watch) this does no X requests and
+// returns without touching the menu if the source has not changed.
 void window_menu_update_windows(WindowMenu *wm);
 
+// Derive wm->window_list from a shared source list on every refresh instead
+// of refreshing the (filtered) window_list itself.
+void window_menu_set_filter(WindowMenu *wm, WindowList *source,
+                            WindowFilterFn filter, const void *filter_data);
+
+// Refresh the window list each time the menu is activated (daemon mode).
+void window_menu_enable_refresh(WindowMenu *wm);
+
 // Cleans up all resources allocated by the window menu.
 void window_menu_cleanup(WindowMenu *wm);
 
@@ -0,0 +1,63 @@
+/* x11_atoms.c - Process-wide cache of interned X11 atoms */
+
+#include "x11_atoms.h"
+#include "x11_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MENU_DEBUG
+#define LOG_PREFIX "[ATOMS]"
+#endif
+#include "log.h"
+
+static const char *atom_names[X11_ATOM_COUNT] = {
+    [X11_ATOM_MOTIF_WM_HINTS] = "_MOTIF_WM_HINTS",
+};
+
+static xcb_atom_t atoms[X11_ATOM_COUNT];
+static xcb_connection_t *atoms_conn = NULL;
+
+bool x11_atoms_init(xcb_connection_t *conn) {
+  if (!conn)
+    return false;
+
+  xcb_intern_atom_cookie_t cookies[X11_ATOM_COUNT];
+  for (int i = 0; i < X11_ATOM_COUNT; i++) {
+    cookies[i] =
+        xcb_intern_atom(conn, 0, strlen(atom_names[i]), atom_names[i]);
+  }
+
+  bool ok = true;
+  x11_rt_batch_begin();
+  for (int i = 0; i < X11_ATOM_COUNT; i++) {
+    xcb_intern_atom_reply_t *reply =
+        X11_SYNC(xcb_intern_atom_reply(conn, cookies[i], NULL));
+    atoms[i] = reply ? reply->atom : XCB_NONE;
+    if (!reply)
+      ok = false;
+    free(reply);
+  }
+  x11_rt_batch_end();
+
+  atoms_conn = conn;
+  LOG("Interned %d atoms", X11_ATOM_COUNT);
+  return ok;
+}
+
+xcb_atom_t x11_atom(xcb_connection_t *conn, X11AtomId id) {
+  if (id < 0 || id >= X11_ATOM_COUNT)
+    return XCB_NONE;
+  if (conn != atoms_conn)
+    x11_atoms_init(conn);
+  return conn && conn == atoms_conn ? atoms[id] : XCB_NONE;
+}
+
+const char *x11_atom_name(X11AtomId id) {
+  return (id >= 0 && id < X11_ATOM_COUNT) ? atom_names[id] : NULL;
+}
+
+void x11_atoms_reset(void) {
+  memset(atoms, 0, sizeof(atoms));
+  atoms_conn = NULL;
+}
@@ -0,0 +1,28 @@
+/* x11_atoms.h - Process-wide cache of interned X11 atoms */
+#ifndef X11_ATOMS_H
+#define X11_ATOMS_H
+
+#include <stdbool.h>
+#include <xcb/xcb.h>
+
+/* Atoms used outside of the EWMH set (those live in xcb_ewmh_connection_t) */
+typedef enum {
+  X11_ATOM_MOTIF_WM_HINTS,
+  X11_ATOM_COUNT
+} X11AtomId;
+
+/* Interns every known atom in one pipelined batch (all requests are sent
+ * before the first reply is read). Call once after connecting. */
+bool x11_atoms_init(xcb_connection_t *conn);
+
+/* Cached atom; interns the whole batch first if x11_atoms_init has not run
+ * for this connection. Returns XCB_NONE on failure. */
+xcb_atom_t x11_atom(xcb_connection_t *conn, X11AtomId id);
+
+/* Atom name as sent to the server */
+const char *x11_atom_name(X11AtomId id);
+
+/* Forget the cache (e.g. before the connection is closed) */
+void x11_atoms_reset(void);
+
+#endif /* X11_ATOMS_H */
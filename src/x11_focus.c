@@ -1,6 +1,9 @@
 /* x11_focus.c - Unchanged input handling and X11 window management */
 
 #include "x11_focus.h"
+#include "x11_atoms.h"
+#include "x11_stats.h"
+#include "x11_window.h"
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,17 +12,6 @@
 #include <xcb/xcb_event.h>
 #include <xcb/xcb_icccm.h>
 
-static xcb_atom_t get_atom(xcb_connection_t *conn, const char *name) {
-  xcb_intern_atom_cookie_t cookie =
-      xcb_intern_atom(conn, 0, strlen(name), name);
-  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
-  if (!reply)
-    return XCB_NONE;
-  xcb_atom_t atom = reply->atom;
-  free(reply);
-  return atom;
-}
-
 X11FocusContext *x11_focus_init(xcb_connection_t *conn, xcb_window_t root,
                                 xcb_ewmh_connection_t *ewmh) {
 
@@ -39,6 +31,9 @@ X11FocusContext *x11_focus_init(xcb_connection_t *conn, xcb_window_t root,
 void x11_focus_cleanup(X11FocusContext *ctx) {
   if (ctx) {
     x11_release_inputs(ctx);
+    for (size_t i = 0; i < ctx->deferred_count; i++)
+      free(ctx->deferred[i]);
+    ctx->deferred_count = 0;
     ctx->conn = NULL;
     ctx->ewmh = NULL;
     /* ctx->previous_focus = XCB_NONE; */
@@ -72,7 +67,7 @@ void x11_set_window_floating(X11FocusContext *ctx, xcb_window_t window) {
     uint32_t status;
   } hints = {2, 0, 0, 0, 0};
 
-  xcb_atom_t motif = get_atom(ctx->conn, "_MOTIF_WM_HINTS");
+  xcb_atom_t motif = x11_atom(ctx->conn, X11_ATOM_MOTIF_WM_HINTS);
   xcb_change_property(ctx->conn, XCB_PROP_MODE_REPLACE, window, motif, motif,
                       32, 5, &hints);
   /* free(motif); */
@@ -81,7 +76,7 @@ void x11_set_window_floating(X11FocusContext *ctx, xcb_window_t window) {
 static void store_current_focus(X11FocusContext *ctx) {
   xcb_get_input_focus_cookie_t cookie = xcb_get_input_focus(ctx->conn);
   xcb_get_input_focus_reply_t *reply =
-      xcb_get_input_focus_reply(ctx->conn, cookie, NULL);
+      X11_SYNC(xcb_get_input_focus_reply(ctx->conn, cookie, NULL));
   if (reply) {
     ctx->previous_focus = reply->focus;
     free(reply);
@@ -169,10 +164,23 @@ static bool wait_for_map_notify(xcb_connection_t *conn, xcb_window_t window,
   return false; // Timeout
 }
 
-static bool take_keyboard(X11FocusContext *ctx, xcb_window_t window,
-                          int max_attempts) {
-  struct timespec delay = {0, 5000000};
-  for (int i = 0; i < max_attempts; i++) {
+static const uint64_t grab_bucket_us[X11_GRAB_BUCKETS - 1] = {
+    1000, 5000, 20000, 100000, 500000};
+
+static uint64_t monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+typedef enum { GRAB_KEYBOARD, GRAB_POINTER } GrabKind;
+
+// One grab request and its reply
+static bool try_grab(X11FocusContext *ctx, xcb_window_t window,
+                     GrabKind kind) {
+  uint8_t status = XCB_GRAB_STATUS_NOT_VIEWABLE;
+  ctx->grab_stats.attempts++;
+  if (kind == GRAB_KEYBOARD) {
     // Grab keyboard input on the specified window
     xcb_grab_keyboard_cookie_t cookie =
         xcb_grab_keyboard(ctx->conn, 1, /* owner_events = true */
@@ -182,23 +190,12 @@ static bool take_keyboard(X11FocusContext *ctx, xcb_window_t window,
                           XCB_GRAB_MODE_ASYNC  /* keyboard_mode */
                           );
     xcb_grab_keyboard_reply_t *reply =
-        xcb_grab_keyboard_reply(ctx->conn, cookie, NULL);
+        X11_SYNC(xcb_grab_keyboard_reply(ctx->conn, cookie, NULL));
     if (reply) {
-      if (reply->status == XCB_GRAB_STATUS_SUCCESS) {
-        free(reply);
-        return true;
-      }
+      status = reply->status;
       free(reply);
     }
-    nanosleep(&delay, NULL);
-  }
-  return false;
-}
-
-static bool take_pointer(X11FocusContext *ctx, xcb_window_t window,
-                         int max_attempts) {
-  struct timespec delay = {0, 5000000};
-  for (int i = 0; i < max_attempts; i++) {
+  } else {
     // Grab pointer input on the specified window, confine cursor to it
     xcb_grab_pointer_cookie_t cookie = xcb_grab_pointer(
         ctx->conn,
@@ -212,17 +209,140 @@ static bool take_pointer(X11FocusContext *ctx, xcb_window_t window,
         XCB_NONE,                          /* cursor */
         XCB_CURRENT_TIME);
     xcb_grab_pointer_reply_t *reply =
-        xcb_grab_pointer_reply(ctx->conn, cookie, NULL);
+        X11_SYNC(xcb_grab_pointer_reply(ctx->conn, cookie, NULL));
     if (reply) {
-      if (reply->status == XCB_GRAB_STATUS_SUCCESS) {
-        free(reply);
-        return true;
-      }
+      status = reply->status;
       free(reply);
     }
-    nanosleep(&delay, NULL);
   }
-  return false;
+  return status == XCB_GRAB_STATUS_SUCCESS;
+}
+
+// Root event mask bit through which an event type reaches us, 0 if the
+// event is not selected on the root window.
+static uint32_t root_mask_for(uint8_t type) {
+  switch (type) {
+  case XCB_FOCUS_IN:
+  case XCB_FOCUS_OUT:
+    return XCB_EVENT_MASK_FOCUS_CHANGE;
+  case XCB_CREATE_NOTIFY:
+  case XCB_DESTROY_NOTIFY:
+  case XCB_UNMAP_NOTIFY:
+  case XCB_MAP_NOTIFY:
+  case XCB_REPARENT_NOTIFY:
+  case XCB_CONFIGURE_NOTIFY:
+  case XCB_GRAVITY_NOTIFY:
+  case XCB_CIRCULATE_NOTIFY:
+    return XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+  default:
+    return 0;
+  }
+}
+
+// Events after which a failed grab is worth retrying: focus moving (a
+// client releasing its grab produces NotifyUngrab focus events) or a
+// popup/menu window going away.
+static bool is_grab_signal(uint8_t type) {
+  return type == XCB_FOCUS_IN || type == XCB_FOCUS_OUT ||
+         type == XCB_UNMAP_NOTIFY || type == XCB_DESTROY_NOTIFY;
+}
+
+void x11_focus_defer_event(X11FocusContext *ctx, xcb_generic_event_t *event) {
+  if (ctx->deferred_count < X11_DEFERRED_EVENTS) {
+    ctx->deferred[ctx->deferred_count++] = event;
+  } else {
+    fprintf(stderr, "[X11] Deferred event queue full, dropping event %u\n",
+            event->response_type & ~0x80);
+    free(event);
+  }
+}
+
+// Reads everything queued on the connection. Events the caller selected
+// itself are kept for the event loop, the ones that only arrive through the
+// temporary grab-wait mask are dropped. Returns true if any of them
+// suggests retrying the grab.
+static bool drain_grab_signals(X11FocusContext *ctx, uint32_t saved_mask) {
+  bool signal = false;
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_event(ctx->conn))) {
+    uint8_t type = event->response_type & ~0x80;
+    if (is_grab_signal(type))
+      signal = true;
+    // Focus and structure events all carry the window they were reported
+    // on right after the sequence number; only root ones are ours to drop.
+    xcb_window_t reported_on = ((xcb_focus_in_event_t *)event)->event;
+    uint32_t bit = root_mask_for(type);
+    if (bit && !(saved_mask & bit) && reported_on == ctx->root)
+      free(event);
+    else
+      x11_focus_defer_event(ctx, event);
+  }
+  return signal;
+}
+
+// Grabs the keyboard or pointer, waiting for grab-release signals until
+// deadline_us (CLOCK_MONOTONIC). A deadline in the past means one attempt.
+static bool grab_until(X11FocusContext *ctx, xcb_window_t window,
+                       GrabKind kind, uint64_t deadline_us) {
+  uint64_t start = monotonic_us();
+  if (try_grab(ctx, window, kind)) {
+    x11_grab_stats_record(&ctx->grab_stats, true, monotonic_us() - start);
+    return true;
+  }
+  if (monotonic_us() >= deadline_us) {
+    x11_grab_stats_record(&ctx->grab_stats, false, monotonic_us() - start);
+    return false;
+  }
+
+  // Someone else holds the grab: listen on the root window for the events
+  // that accompany its release, keeping whatever mask we already had.
+  uint32_t saved_mask = 0;
+  xcb_get_window_attributes_reply_t *attrs =
+      X11_SYNC(xcb_get_window_attributes_reply(
+          ctx->conn, xcb_get_window_attributes(ctx->conn, ctx->root), NULL));
+  if (attrs) {
+    saved_mask = attrs->your_event_mask;
+    free(attrs);
+  }
+  uint32_t wait_mask = saved_mask | XCB_EVENT_MASK_FOCUS_CHANGE |
+                       XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+  xcb_change_window_attributes(ctx->conn, ctx->root, XCB_CW_EVENT_MASK,
+                               &wait_mask);
+  xcb_flush(ctx->conn);
+
+  struct pollfd pfd = {.fd = xcb_get_file_descriptor(ctx->conn),
+                       .events = POLLIN};
+  bool grabbed = false;
+  uint64_t now;
+  uint64_t retry_us = monotonic_us() + (uint64_t)X11_GRAB_FALLBACK_MS * 1000;
+  while (!grabbed && (now = monotonic_us()) < deadline_us) {
+    // Replies read by try_grab may have queued events already
+    bool signal = drain_grab_signals(ctx, saved_mask);
+    if (!signal && now < retry_us) {
+      uint64_t until = retry_us < deadline_us ? retry_us : deadline_us;
+      int ret = poll(&pfd, 1, (int)((until - now + 999) / 1000));
+      if (ret < 0) {
+        perror("poll failed");
+        break;
+      }
+      if (ret > 0)
+        signal = drain_grab_signals(ctx, saved_mask);
+      // Other traffic woke us up: keep waiting, a grab costs a round-trip
+      now = monotonic_us();
+      if (!signal && now < retry_us && now < deadline_us)
+        continue;
+    }
+    // Retry on a signal, or once the fallback interval expired: not every
+    // grab release is visible to us as an event.
+    grabbed = try_grab(ctx, window, kind);
+    retry_us = monotonic_us() + (uint64_t)X11_GRAB_FALLBACK_MS * 1000;
+  }
+
+  xcb_change_window_attributes(ctx->conn, ctx->root, XCB_CW_EVENT_MASK,
+                               &saved_mask);
+  xcb_flush(ctx->conn);
+  x11_grab_stats_record(&ctx->grab_stats, grabbed, monotonic_us() - start);
+  return grabbed;
 }
 
 bool x11_grab_inputs(X11FocusContext *ctx, xcb_window_t window) {
@@ -247,13 +367,14 @@ bool x11_grab_inputs(X11FocusContext *ctx, xcb_window_t window) {
   /*   fprintf(stderr, "MapNotify event timeout"); */
   /* } */
 
-  if (!take_keyboard(ctx, window, 500)) {
+  uint64_t deadline = monotonic_us() + (uint64_t)X11_GRAB_DEADLINE_MS * 1000;
+  if (!grab_until(ctx, window, GRAB_KEYBOARD, deadline)) {
     fprintf(stderr, "[X11] Keyboard grab failed\n");
     restore_previous_focus(ctx);
     return false;
   }
 
-  if (!take_pointer(ctx, window, 500)) {
+  if (!grab_until(ctx, window, GRAB_POINTER, deadline)) {
     fprintf(stderr, "[X11] Pointer grab failed\n");
     xcb_ungrab_keyboard(ctx->conn, XCB_CURRENT_TIME);
     restore_previous_focus(ctx);
@@ -272,3 +393,268 @@ void x11_release_inputs(X11FocusContext *ctx) {
   restore_previous_focus(ctx);
   xcb_flush(ctx->conn);
 }
+
+bool x11_grab_key(X11FocusContext *ctx, uint16_t modifiers, uint8_t keycode) {
+  static const uint16_t lock_variants[] = {
+      0, XCB_MOD_MASK_LOCK, XCB_MOD_MASK_2,
+      XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2};
+  xcb_void_cookie_t cookies[4];
+  size_t count = sizeof(lock_variants) / sizeof(lock_variants[0]);
+
+  // Send every variant before checking any reply
+  for (size_t i = 0; i < count; i++) {
+    cookies[i] = xcb_grab_key_checked(ctx->conn, 1, ctx->root,
+                                      modifiers | lock_variants[i], keycode,
+                                      XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+  }
+
+  bool ok = true;
+  x11_rt_batch_begin();
+  for (size_t i = 0; i < count; i++) {
+    xcb_generic_error_t *error =
+        X11_SYNC(xcb_request_check(ctx->conn, cookies[i]));
+    if (error) {
+      fprintf(stderr, "[X11] Key grab failed (mods=0x%x key=%u error=%u)\n",
+              modifiers | lock_variants[i], keycode, error->error_code);
+      free(error);
+      ok = false;
+    }
+  }
+  x11_rt_batch_end();
+  return ok;
+}
+
+void x11_ungrab_keys(X11FocusContext *ctx) {
+  xcb_ungrab_key(ctx->conn, XCB_GRAB_ANY, ctx->root, XCB_MOD_MASK_ANY);
+  xcb_flush(ctx->conn);
+}
+
+bool x11_grab_inputs_once(X11FocusContext *ctx, xcb_window_t window) {
+  store_current_focus(ctx);
+
+  if (!grab_until(ctx, window, GRAB_KEYBOARD, 0)) {
+    fprintf(stderr, "[X11] Keyboard grab failed\n");
+    return false;
+  }
+  // The pointer is not needed for navigation; keep going without it.
+  if (!grab_until(ctx, window, GRAB_POINTER, 0)) {
+    fprintf(stderr, "[X11] Pointer grab failed, continuing without it\n");
+  }
+  xcb_set_input_focus(ctx->conn, XCB_INPUT_FOCUS_POINTER_ROOT, window,
+                      XCB_CURRENT_TIME);
+  xcb_flush(ctx->conn);
+  return true;
+}
+
+void x11_ungrab_inputs(X11FocusContext *ctx) {
+  xcb_ungrab_keyboard(ctx->conn, XCB_CURRENT_TIME);
+  xcb_ungrab_pointer(ctx->conn, XCB_CURRENT_TIME);
+  // x11_grab_inputs_once moved the focus to the menu's window
+  restore_previous_focus(ctx);
+  xcb_flush(ctx->conn);
+}
+
+// Absolute geometry of the active window (off the hot path: called when
+// the window manager reports a change, not when a menu is shown)
+static void active_fetch_geometry(X11FocusContext *ctx) {
+  X11ActiveWindow *active = &ctx->active;
+  active->valid = false;
+  if (active->window == XCB_NONE)
+    return;
+
+  // Both requests go out before either reply is read: one round-trip
+  xcb_get_geometry_cookie_t geo_cookie =
+      xcb_get_geometry(ctx->conn, active->window);
+  xcb_translate_coordinates_cookie_t abs_cookie =
+      xcb_translate_coordinates(ctx->conn, active->window, ctx->root, 0, 0);
+  x11_rt_batch_begin();
+  xcb_get_geometry_reply_t *geo =
+      X11_SYNC(xcb_get_geometry_reply(ctx->conn, geo_cookie, NULL));
+  xcb_translate_coordinates_reply_t *abs = X11_SYNC(
+      xcb_translate_coordinates_reply(ctx->conn, abs_cookie, NULL));
+  x11_rt_batch_end();
+  if (geo && abs) {
+    active->x = abs->dst_x;
+    active->y = abs->dst_y;
+    active->width = geo->width;
+    active->height = geo->height;
+    active->reparented = abs->dst_x != geo->x || abs->dst_y != geo->y;
+    active->valid = true;
+  }
+  free(abs);
+  free(geo);
+}
+
+static void active_set_window(X11FocusContext *ctx, xcb_window_t window) {
+  X11ActiveWindow *active = &ctx->active;
+  // The previous window keeps only what the window list selected on it
+  if (active->window != XCB_NONE && active->window != window) {
+    uint32_t mask = active->client_mask;
+    xcb_change_window_attributes(ctx->conn, active->window, XCB_CW_EVENT_MASK,
+                                 &mask);
+  }
+  active->window = window;
+  if (window != XCB_NONE) {
+    // The mask is per client: keep the window list's events coming
+    uint32_t mask = active->client_mask | X11_ACTIVE_EVENT_MASK;
+    xcb_change_window_attributes(ctx->conn, window, XCB_CW_EVENT_MASK, &mask);
+  }
+  active_fetch_geometry(ctx);
+}
+
+static xcb_window_t active_read_window(X11FocusContext *ctx) {
+  xcb_window_t window = XCB_NONE;
+  if (!ctx->ewmh ||
+      !X11_SYNC_OK(xcb_ewmh_get_active_window_reply(
+          ctx->ewmh, xcb_ewmh_get_active_window(ctx->ewmh, 0), &window, NULL)))
+    return XCB_NONE;
+  return window;
+}
+
+bool x11_focus_track_active(X11FocusContext *ctx) {
+  if (!ctx || !ctx->conn)
+    return false;
+
+  // Keep whatever else is selected on the root window
+  uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+  xcb_get_window_attributes_reply_t *attrs =
+      X11_SYNC(xcb_get_window_attributes_reply(
+          ctx->conn, xcb_get_window_attributes(ctx->conn, ctx->root), NULL));
+  if (attrs) {
+    mask |= attrs->your_event_mask;
+    free(attrs);
+  }
+  xcb_change_window_attributes(ctx->conn, ctx->root, XCB_CW_EVENT_MASK, &mask);
+
+  active_set_window(ctx, active_read_window(ctx));
+  xcb_flush(ctx->conn);
+  ctx->active.tracking = true;
+  return true;
+}
+
+bool x11_focus_handle_event(X11FocusContext *ctx, xcb_generic_event_t *event) {
+  if (!ctx || !ctx->active.tracking || !event)
+    return false;
+  X11ActiveWindow *active = &ctx->active;
+
+  switch (event->response_type & ~0x80) {
+  case XCB_PROPERTY_NOTIFY: {
+    xcb_property_notify_event_t *pn = (xcb_property_notify_event_t *)event;
+    if (pn->window != ctx->root || !ctx->ewmh ||
+        pn->atom != ctx->ewmh->_NET_ACTIVE_WINDOW)
+      return false;
+    xcb_window_t window = active_read_window(ctx);
+    if (window == active->window)
+      return false;
+    active_set_window(ctx, window);
+    return true;
+  }
+  case XCB_CONFIGURE_NOTIFY: {
+    xcb_configure_notify_event_t *cn = (xcb_configure_notify_event_t *)event;
+    if (cn->window != active->window)
+      return false;
+    active->width = cn->width;
+    active->height = cn->height;
+    if (event->response_type & 0x80) {
+      // Synthetic (ICCCM 4.1.5): the window manager reports root coordinates
+      active->x = cn->x;
+      active->y = cn->y;
+      active->valid = true;
+    } else if (!active->reparented) {
+      active->x = cn->x;
+      active->y = cn->y;
+      active->valid = true;
+    } else {
+      // Relative to the frame; ask once now rather than at show time
+      active_fetch_geometry(ctx);
+    }
+    return true;
+  }
+  case XCB_DESTROY_NOTIFY: {
+    xcb_destroy_notify_event_t *dn = (xcb_destroy_notify_event_t *)event;
+    if (dn->window != active->window)
+      return false;
+    active->window = XCB_NONE;
+    active->valid = false;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool x11_focus_active_geometry(const X11FocusContext *ctx, int *x, int *y,
+                               int *width, int *height) {
+  // Nothing active (an empty desktop, or a window manager that does not
+  // set _NET_ACTIVE_WINDOW): the input focus fallback knows better
+  if (!ctx || !ctx->active.tracking || ctx->active.window == XCB_NONE ||
+      !ctx->active.valid)
+    return false;
+  if (x)
+    *x = ctx->active.x;
+  if (y)
+    *y = ctx->active.y;
+  if (width)
+    *width = ctx->active.width;
+  if (height)
+    *height = ctx->active.height;
+  return true;
+}
+
+xcb_generic_event_t *x11_focus_poll_event(X11FocusContext *ctx) {
+  if (ctx->deferred_count > 0) {
+    xcb_generic_event_t *event = ctx->deferred[0];
+    ctx->deferred_count--;
+    memmove(ctx->deferred, ctx->deferred + 1,
+            ctx->deferred_count * sizeof(ctx->deferred[0]));
+    return event;
+  }
+  return xcb_poll_for_event(ctx->conn);
+}
+
+bool x11_focus_has_deferred_events(const X11FocusContext *ctx) {
+  return ctx && ctx->deferred_count > 0;
+}
+
+const X11GrabStats *x11_focus_get_grab_stats(const X11FocusContext *ctx) {
+  return ctx ? &ctx->grab_stats : NULL;
+}
+
+void x11_grab_stats_record(X11GrabStats *stats, bool success,
+                           uint64_t elapsed_us) {
+  if (!success) {
+    stats->failures++;
+    return;
+  }
+  if (stats->grabs == 0 || elapsed_us < stats->min_us)
+    stats->min_us = elapsed_us;
+  if (elapsed_us > stats->max_us)
+    stats->max_us = elapsed_us;
+  stats->grabs++;
+  stats->last_us = elapsed_us;
+  stats->total_us += elapsed_us;
+
+  size_t bucket = 0;
+  while (bucket < X11_GRAB_BUCKETS - 1 && elapsed_us >= grab_bucket_us[bucket])
+    bucket++;
+  stats->buckets[bucket]++;
+}
+
+int x11_grab_stats_format(const X11GrabStats *stats, char *buf, size_t size) {
+  if (!stats || !buf || size == 0)
+    return 0;
+  return snprintf(buf, size,
+                  "Grabs: %lu ok, %lu failed, %lu attempts\n"
+                  "Time-to-grab: last %lluus min %lluus avg %lluus max %lluus\n"
+                  "Time-to-grab <1ms:%lu <5ms:%lu <20ms:%lu <100ms:%lu "
+                  "<500ms:%lu >=500ms:%lu\n",
+                  stats->grabs, stats->failures, stats->attempts,
+                  (unsigned long long)stats->last_us,
+                  (unsigned long long)stats->min_us,
+                  (unsigned long long)(stats->grabs
+                                           ? stats->total_us / stats->grabs
+                                           : 0),
+                  (unsigned long long)stats->max_us, stats->buckets[0],
+                  stats->buckets[1], stats->buckets[2], stats->buckets[3],
+                  stats->buckets[4], stats->buckets[5]);
+}
@@ -4,14 +4,52 @@
 #define X11_FOCUS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
 
+// Deadline for acquiring keyboard + pointer (shared by both grabs)
+#define X11_GRAB_DEADLINE_MS 1000
+// Re-try interval when no grab-release signal arrives in the meantime
+#define X11_GRAB_FALLBACK_MS 50
+// Events read while waiting for a grab, handed back to the event loop
+#define X11_DEFERRED_EVENTS 64
+
+// Time-to-grab histogram: <1ms, <5ms, <20ms, <100ms, <500ms, slower
+#define X11_GRAB_BUCKETS 6
+
+typedef struct {
+  unsigned long grabs;    // Successful grabs
+  unsigned long failures; // Grabs that ran into the deadline
+  unsigned long attempts; // Grab requests sent
+  uint64_t last_us;       // Time-to-grab of the latest success
+  uint64_t min_us;
+  uint64_t max_us;
+  uint64_t total_us;
+  unsigned long buckets[X11_GRAB_BUCKETS];
+} X11GrabStats;
+
+// Active window as last reported by the window manager
+typedef struct {
+  xcb_window_t window;   // _NET_ACTIVE_WINDOW (XCB_NONE if unknown)
+  int16_t x, y;          // Absolute position (root coordinates)
+  uint16_t width, height;
+  bool valid;            // Geometry above is current
+  bool reparented;       // Parent is a WM frame: ConfigureNotify is relative
+  bool tracking;         // Kept current by x11_focus_handle_event
+  uint32_t client_mask;  // Selected on every client by the live window list
+} X11ActiveWindow;
+
 typedef struct {
   xcb_connection_t *conn;
   xcb_window_t previous_focus;
   xcb_window_t root;
   xcb_ewmh_connection_t *ewmh;
+  X11GrabStats grab_stats;
+  xcb_generic_event_t *deferred[X11_DEFERRED_EVENTS];
+  size_t deferred_count;
+  X11ActiveWindow active;
 } X11FocusContext;
 
 // Initialization and cleanup
@@ -22,8 +60,51 @@ void x11_focus_cleanup(X11FocusContext *ctx);
 // Window management
 void x11_set_window_floating(X11FocusContext *ctx, xcb_window_t window);
 
+// Lock modifiers (Caps Lock, Num Lock) that must not affect key matching
+#define X11_LOCK_MASKS (XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2)
+
 // Input handling
+// Grabs are retried when the X server signals that another client may have
+// released its grab (FocusIn/FocusOut, UnmapNotify) until
+// X11_GRAB_DEADLINE_MS has passed.
 bool x11_grab_inputs(X11FocusContext *ctx, xcb_window_t window);
 void x11_release_inputs(X11FocusContext *ctx);
 
+// Events that arrived while waiting for a grab. The event loop must drain
+// these before reading from the connection; x11_focus_poll_event does both.
+xcb_generic_event_t *x11_focus_poll_event(X11FocusContext *ctx);
+bool x11_focus_has_deferred_events(const X11FocusContext *ctx);
+// Queues an event already read from the connection; takes ownership
+void x11_focus_defer_event(X11FocusContext *ctx, xcb_generic_event_t *event);
+
+// Active window tracker: follows _NET_ACTIVE_WINDOW on the root window and
+// ConfigureNotify on the active window, so menu placement needs no
+// requests when a menu is shown.
+bool x11_focus_track_active(X11FocusContext *ctx);
+// Returns true if the event updated the active window or its geometry
+bool x11_focus_handle_event(X11FocusContext *ctx, xcb_generic_event_t *event);
+// Cached geometry of the active window; false if not tracked, if no window
+// is active or if its geometry is not known
+bool x11_focus_active_geometry(const X11FocusContext *ctx, int *x, int *y,
+                               int *width, int *height);
+
+// Time-to-grab metrics
+const X11GrabStats *x11_focus_get_grab_stats(const X11FocusContext *ctx);
+void x11_grab_stats_record(X11GrabStats *stats, bool success,
+                           uint64_t elapsed_us);
+int x11_grab_stats_format(const X11GrabStats *stats, char *buf, size_t size);
+
+// Passive key grabs: register modifiers+keycode (and every lock-mask
+// variant) on the root window so the process receives its trigger keys
+// without holding the keyboard.
+bool x11_grab_key(X11FocusContext *ctx, uint16_t modifiers, uint8_t keycode);
+void x11_ungrab_keys(X11FocusContext *ctx);
+
+// Active grab while a menu is visible: no waiting (the passive grab that
+// delivered the trigger key already owns the keyboard).
+// x11_ungrab_inputs drops it again and gives the focus back to the window
+// that had it before the grab.
+bool x11_grab_inputs_once(X11FocusContext *ctx, xcb_window_t window);
+void x11_ungrab_inputs(X11FocusContext *ctx);
+
 #endif
@@ -0,0 +1,111 @@
+/* x11_stats.c - Round-trip accounting per logical operation */
+
+#include "x11_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define X11_OP_STACK_DEPTH 16
+
+static const char *op_names[X11_OP_COUNT] = {
+    [X11_OP_SETUP] = "setup",   [X11_OP_REFRESH] = "refresh",
+    [X11_OP_SHOW] = "show",     [X11_OP_SELECT] = "select",
+    [X11_OP_ACTIVATE] = "activate",
+};
+
+static X11OpStats stats[X11_OP_COUNT];
+static X11Op op_stack[X11_OP_STACK_DEPTH];
+static int op_depth = 0;
+static int batch_depth = 0;
+static bool batch_counted = false;
+static uint64_t wait_start = 0;
+
+static uint64_t monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record_wait(void) {
+  uint64_t elapsed = monotonic_us() - wait_start;
+  bool round_trip = batch_depth == 0 || !batch_counted;
+  if (batch_depth > 0)
+    batch_counted = true;
+
+  unsigned seen = 0; // Each operation counts once however deeply nested
+  int depth = op_depth < X11_OP_STACK_DEPTH ? op_depth : X11_OP_STACK_DEPTH;
+  for (int i = 0; i < depth; i++) {
+    X11Op op = op_stack[i];
+    if (seen & (1u << op))
+      continue;
+    seen |= 1u << op;
+    stats[op].replies++;
+    stats[op].wait_us += elapsed;
+    if (round_trip)
+      stats[op].round_trips++;
+  }
+}
+
+void x11_rt_wait_begin(void) { wait_start = monotonic_us(); }
+
+void *x11_rt_wait_end(void *reply) {
+  record_wait();
+  return reply;
+}
+
+int x11_rt_wait_end_status(int status) {
+  record_wait();
+  return status;
+}
+
+void x11_rt_batch_begin(void) {
+  if (batch_depth++ == 0)
+    batch_counted = false;
+}
+
+void x11_rt_batch_end(void) {
+  if (batch_depth > 0)
+    batch_depth--;
+}
+
+void x11_op_enter(X11Op op) {
+  if (op < 0 || op >= X11_OP_COUNT)
+    return;
+  if (op_depth < X11_OP_STACK_DEPTH)
+    op_stack[op_depth] = op;
+  op_depth++;
+  stats[op].calls++;
+}
+
+void x11_op_leave(void) {
+  if (op_depth > 0)
+    op_depth--;
+}
+
+const X11OpStats *x11_op_stats(X11Op op) {
+  return (op >= 0 && op < X11_OP_COUNT) ? &stats[op] : NULL;
+}
+
+const char *x11_op_name(X11Op op) {
+  return (op >= 0 && op < X11_OP_COUNT) ? op_names[op] : NULL;
+}
+
+void x11_op_stats_reset(void) { memset(stats, 0, sizeof(stats)); }
+
+int x11_op_stats_format(char *buf, size_t size) {
+  if (!buf || size == 0)
+    return 0;
+  size_t len = 0;
+  buf[0] = '\0';
+  for (int i = 0; i < X11_OP_COUNT && len < size; i++) {
+    int n = snprintf(buf + len, size - len,
+                     "RT %s: %lu round-trips, %lu replies, %lluus in %lu "
+                     "calls\n",
+                     op_names[i], stats[i].round_trips, stats[i].replies,
+                     (unsigned long long)stats[i].wait_us, stats[i].calls);
+    if (n < 0)
+      break;
+    len += (size_t)n;
+  }
+  return (int)(len < size ? len : size - 1);
+}
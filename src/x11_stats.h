@@ -0,0 +1,53 @@
+/* x11_stats.h - Round-trip accounting per logical operation */
+#ifndef X11_STATS_H
+#define X11_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Logical operations round-trips are attributed to. Operations nest; a
+ * reply wait is counted for every distinct operation currently entered
+ * (e.g. the select performed at the end of a show counts for both). */
+typedef enum {
+  X11_OP_SETUP,    /* Connection and input setup */
+  X11_OP_REFRESH,  /* Window list refresh / live updates */
+  X11_OP_SHOW,     /* Mapping and painting a menu */
+  X11_OP_SELECT,   /* Selection change, including window activation */
+  X11_OP_ACTIVATE, /* Trigger key to menu ready (grab, refresh, show) */
+  X11_OP_COUNT
+} X11Op;
+
+typedef struct {
+  unsigned long calls;       /* Times the operation was entered */
+  unsigned long round_trips; /* Blocking round-trips (a batch counts once) */
+  unsigned long replies;     /* Reply waits, batched or not */
+  uint64_t wait_us;          /* Wall time spent waiting for replies */
+} X11OpStats;
+
+/* Wrap every blocking xcb_*_reply / xcb_request_check call:
+ *   reply = X11_SYNC(xcb_get_geometry_reply(conn, cookie, NULL));
+ *   if (X11_SYNC_OK(xcb_ewmh_get_wm_desktop_reply(...)))
+ * The comma operator sequences begin -> call -> end. */
+#define X11_SYNC(call) (x11_rt_wait_begin(), x11_rt_wait_end(call))
+#define X11_SYNC_OK(call) (x11_rt_wait_begin(), x11_rt_wait_end_status(call))
+
+void x11_rt_wait_begin(void);
+void *x11_rt_wait_end(void *reply);
+int x11_rt_wait_end_status(int status);
+
+/* Replies collected between batch begin/end belong to requests that were all
+ * sent up front; they count as a single round-trip. Batches nest. */
+void x11_rt_batch_begin(void);
+void x11_rt_batch_end(void);
+
+/* Operation scope */
+void x11_op_enter(X11Op op);
+void x11_op_leave(void);
+
+const X11OpStats *x11_op_stats(X11Op op);
+const char *x11_op_name(X11Op op);
+void x11_op_stats_reset(void);
+int x11_op_stats_format(char *buf, size_t size);
+
+#endif /* X11_STATS_H */
@@ -1,5 +1,6 @@
 #define _GNU_SOURCE // Required for asprintf
 #include "x11_window.h"
+#include "x11_stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,32 +17,20 @@
 static void get_window_class_name(xcb_connection_t *conn, xcb_window_t window,
                                   char **class_name, char **instance_name);
 
-static xcb_atom_t get_atom(xcb_connection_t *conn, const char *atom_name) {
-  xcb_intern_atom_cookie_t cookie =
-      xcb_intern_atom(conn, 0, strlen(atom_name), atom_name);
-  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
-
-  if (!reply) {
-    return XCB_NONE;
-  }
-
-  xcb_atom_t atom = reply->atom;
-  free(reply);
-  return atom;
-}
-
-static char *get_window_title(xcb_connection_t *conn, xcb_window_t window) {
+static char *get_window_title(xcb_connection_t *conn,
+                              xcb_ewmh_connection_t *ewmh,
+                              xcb_window_t window) {
   xcb_get_property_cookie_t cookie;
   xcb_get_property_reply_t *reply;
   char *title = NULL;
-  xcb_atom_t utf8_string = get_atom(conn, "UTF8_STRING");
+  xcb_atom_t utf8_string = ewmh->UTF8_STRING;
 
   // Try _NET_WM_NAME first (UTF-8)
-  xcb_atom_t net_wm_name = get_atom(conn, "_NET_WM_NAME");
+  xcb_atom_t net_wm_name = ewmh->_NET_WM_NAME;
   if (net_wm_name != XCB_NONE) {
     cookie =
         xcb_get_property(conn, 0, window, net_wm_name, utf8_string, 0, 1024);
-    reply = xcb_get_property_reply(conn, cookie, NULL);
+    reply = X11_SYNC(xcb_get_property_reply(conn, cookie, NULL));
 
     if (reply && reply->value_len > 0) {
       int len = xcb_get_property_value_length(reply);
@@ -57,7 +46,8 @@ static char *get_window_title(xcb_connection_t *conn, xcb_window_t window) {
   // Try WM_NAME (ICCCM)
   xcb_get_property_cookie_t name_cookie = xcb_icccm_get_wm_name(conn, window);
   xcb_icccm_get_text_property_reply_t icccm_reply;
-  if (xcb_icccm_get_wm_name_reply(conn, name_cookie, &icccm_reply, NULL)) {
+  if (X11_SYNC_OK(xcb_icccm_get_wm_name_reply(conn, name_cookie, &icccm_reply,
+                                              NULL))) {
     title = strdup((char *)icccm_reply.name);
     xcb_icccm_get_text_property_reply_wipe(&icccm_reply);
     return title;
@@ -71,14 +61,14 @@ static char *get_window_title(xcb_connection_t *conn, xcb_window_t window) {
   if (class_name && strcmp(class_name, "i3-frame") == 0) {
     xcb_query_tree_cookie_t tree_cookie = xcb_query_tree(conn, window);
     xcb_query_tree_reply_t *tree_reply =
-        xcb_query_tree_reply(conn, tree_cookie, NULL);
+        X11_SYNC(xcb_query_tree_reply(conn, tree_cookie, NULL));
 
     if (tree_reply) {
       xcb_window_t *children = xcb_query_tree_children(tree_reply);
       int len = xcb_query_tree_children_length(tree_reply);
 
       if (len > 0) {
-        char *child_title = get_window_title(conn, children[0]);
+        char *child_title = get_window_title(conn, ewmh, children[0]);
         if (child_title && strcmp(child_title, "<Untitled>") != 0) {
           free(class_name);
           free(instance_name);
@@ -110,6 +100,13 @@ WindowList *window_list_init(xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh
 
   list->count = 0;
   list->capacity = INITIAL_CAPACITY;
+  list->clients = NULL;
+  list->client_count = 0;
+  list->client_capacity = 0;
+  list->root = XCB_NONE;
+  list->active = XCB_NONE;
+  list->live = false;
+  list->version = 0;
   window_list_update(list, conn, ewmh); // Pass ewmh here
   return list;
 }
@@ -126,6 +123,7 @@ void window_list_free(WindowList *list) {
   }
 
   free(list->windows);
+  free(list->clients);
   free(list);
 }
 
@@ -134,7 +132,7 @@ static void get_window_class_name(xcb_connection_t *conn, xcb_window_t window,
   xcb_get_property_cookie_t cookie = xcb_icccm_get_wm_class(conn, window);
   xcb_icccm_get_wm_class_reply_t reply;
 
-  if (xcb_icccm_get_wm_class_reply(conn, cookie, &reply, NULL)) {
+  if (X11_SYNC_OK(xcb_icccm_get_wm_class_reply(conn, cookie, &reply, NULL))) {
     *instance_name = strdup((char *)reply.instance_name);
     *class_name = strdup((char *)reply.class_name);
     xcb_icccm_get_wm_class_reply_wipe(&reply);
@@ -144,7 +142,542 @@ static void get_window_class_name(xcb_connection_t *conn, xcb_window_t window,
   }
 }
 
-void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh) {
+/* Requests and results for one window during a pipelined refresh */
+typedef struct {
+  xcb_window_t id;     // Client window from _NET_CLIENT_LIST_STACKING
+  xcb_window_t target; // Window the title/class are read from (i3 child)
+  xcb_get_property_cookie_t class_cookie;
+  xcb_get_property_cookie_t name_cookie;
+  xcb_get_property_cookie_t wm_name_cookie;
+  xcb_get_property_cookie_t desktop_cookie;
+  xcb_query_tree_cookie_t tree_cookie;
+  char *class_name;
+  char *instance_name;
+  char *title;
+  uint32_t desktop;
+} WindowFetch;
+
+static void fetch_send_props(xcb_connection_t *conn,
+                             xcb_ewmh_connection_t *ewmh, WindowFetch *f,
+                             xcb_window_t window) {
+  f->target = window;
+  f->class_cookie = xcb_icccm_get_wm_class(conn, window);
+  f->name_cookie = xcb_get_property(conn, 0, window, ewmh->_NET_WM_NAME,
+                                    ewmh->UTF8_STRING, 0, 1024);
+  f->wm_name_cookie = xcb_icccm_get_wm_name(conn, window);
+}
+
+static void fetch_read_props(xcb_connection_t *conn, WindowFetch *f) {
+  xcb_icccm_get_wm_class_reply_t class_reply;
+  if (X11_SYNC_OK(xcb_icccm_get_wm_class_reply(conn, f->class_cookie,
+                                               &class_reply, NULL))) {
+    f->instance_name = strdup((char *)class_reply.instance_name);
+    f->class_name = strdup((char *)class_reply.class_name);
+    xcb_icccm_get_wm_class_reply_wipe(&class_reply);
+  } else {
+    f->instance_name = strdup("Unknown");
+    f->class_name = strdup("Unknown");
+  }
+
+  // Try _NET_WM_NAME first (UTF-8)
+  xcb_get_property_reply_t *reply =
+      X11_SYNC(xcb_get_property_reply(conn, f->name_cookie, NULL));
+  if (reply && reply->value_len > 0) {
+    int len = xcb_get_property_value_length(reply);
+    f->title = malloc(len + 1);
+    if (f->title) {
+      memcpy(f->title, xcb_get_property_value(reply), len);
+      f->title[len] = '\0';
+    }
+  }
+  free(reply);
+
+  // WM_NAME (ICCCM) was requested alongside; only used as a fallback
+  if (f->title) {
+    xcb_discard_reply(conn, f->wm_name_cookie.sequence);
+    return;
+  }
+  xcb_icccm_get_text_property_reply_t icccm_reply;
+  if (X11_SYNC_OK(xcb_icccm_get_wm_name_reply(conn, f->wm_name_cookie,
+                                              &icccm_reply, NULL))) {
+    f->title = strndup((char *)icccm_reply.name, icccm_reply.name_len);
+    xcb_icccm_get_text_property_reply_wipe(&icccm_reply);
+  }
+}
+
+static void fetch_clear_props(WindowFetch *f) {
+  free(f->class_name);
+  free(f->instance_name);
+  free(f->title);
+  f->class_name = f->instance_name = f->title = NULL;
+}
+
+static bool fetch_is_i3_frame(const WindowFetch *f) {
+  return f->class_name && strcmp(f->class_name, "i3-frame") == 0;
+}
+
+/* Fetches class, title and desktop for n windows in one pipelined batch
+ * (plus two more batches if any of them are i3 frames). f[i].id must be
+ * set; the strings end up owned by f. */
+static void fetch_windows(xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh,
+                          WindowFetch *f, size_t n) {
+  // Phase 1: send class, title and desktop requests for every window
+  for (size_t i = 0; i < n; i++) {
+    fetch_send_props(conn, ewmh, &f[i], f[i].id);
+    f[i].desktop_cookie = xcb_ewmh_get_wm_desktop(ewmh, f[i].id);
+  }
+
+  // Phase 2: collect
+  size_t frames = 0;
+  x11_rt_batch_begin();
+  for (size_t i = 0; i < n; i++) {
+    fetch_read_props(conn, &f[i]);
+    if (!X11_SYNC_OK(xcb_ewmh_get_wm_desktop_reply(ewmh, f[i].desktop_cookie,
+                                                   &f[i].desktop, NULL)))
+      f[i].desktop = 0;
+    if (fetch_is_i3_frame(&f[i]))
+      frames++;
+  }
+  x11_rt_batch_end();
+  if (frames == 0)
+    return;
+
+  // i3 containers: the title lives on the first child of the frame. Resolve
+  // all children in one batch, then fetch their properties in another.
+  for (size_t i = 0; i < n; i++) {
+    if (fetch_is_i3_frame(&f[i]))
+      f[i].tree_cookie = xcb_query_tree(conn, f[i].id);
+  }
+  x11_rt_batch_begin();
+  for (size_t i = 0; i < n; i++) {
+    if (!fetch_is_i3_frame(&f[i]))
+      continue;
+    xcb_query_tree_reply_t *tree_reply =
+        X11_SYNC(xcb_query_tree_reply(conn, f[i].tree_cookie, NULL));
+    if (tree_reply && xcb_query_tree_children_length(tree_reply) > 0) {
+      xcb_window_t child = xcb_query_tree_children(tree_reply)[0];
+      fetch_clear_props(&f[i]);
+      fetch_send_props(conn, ewmh, &f[i], child);
+    }
+    free(tree_reply);
+  }
+  x11_rt_batch_end();
+  x11_rt_batch_begin();
+  for (size_t i = 0; i < n; i++) {
+    if (f[i].target != f[i].id)
+      fetch_read_props(conn, &f[i]);
+  }
+  x11_rt_batch_end();
+}
+
+static bool fetch_has_title(const WindowFetch *f) {
+  return f->title && strcmp(f->title, "<Untitled>") != 0;
+}
+
+static void window_clear(X11Window *w) {
+  free(w->title);
+  free(w->className);
+  free(w->instance);
+  free(w->name);
+}
+
+// Moves the fetched strings into w
+static void window_from_fetch(X11Window *w, WindowFetch *f) {
+  w->id = f->id;
+  w->title_window = f->target;
+  w->desktop = f->desktop;
+
+  char *desktop_title = NULL;
+  if (asprintf(&desktop_title, "[%d] %s", w->desktop, f->title) != -1) {
+    free(f->title);
+    w->title = desktop_title;
+  } else {
+    w->title = f->title;
+  }
+  w->className = f->class_name;
+  w->instance = f->instance_name;
+  w->name = strdup(w->title);
+  f->title = f->class_name = f->instance_name = NULL;
+}
+
+static bool window_list_reserve(WindowList *list, size_t capacity) {
+  if (capacity <= list->capacity)
+    return true;
+  X11Window *new_windows = realloc(list->windows, sizeof(X11Window) * capacity);
+  if (!new_windows)
+    return false;
+  list->windows = new_windows;
+  list->capacity = capacity;
+  return true;
+}
+
+static void window_list_set_clients(WindowList *list,
+                                    const xcb_window_t *clients, size_t n) {
+  if (n > list->client_capacity) {
+    xcb_window_t *new_clients =
+        realloc(list->clients, sizeof(xcb_window_t) * n);
+    if (!new_clients) {
+      list->client_count = 0;
+      return;
+    }
+    list->clients = new_clients;
+    list->client_capacity = n;
+  }
+  if (n > 0)
+    memcpy(list->clients, clients, sizeof(xcb_window_t) * n);
+  list->client_count = n;
+}
+
+/* Pipelined refresh: every request for every window is sent before the
+ * first reply is read, so the cost is a fixed number of round-trips
+ * (client list, properties, and two more only if i3 frames are present)
+ * instead of several per window. */
+static void window_list_fetch_pipelined(WindowList *list,
+                                        xcb_connection_t *conn,
+                                        xcb_ewmh_connection_t *ewmh) {
+  LOG("Updating window list (pipelined)");
+  if (!ewmh) {
+    fprintf(stderr,
+            "[ERROR] EWMH connection not provided to window_list_update\n");
+    return;
+  }
+
+  xcb_get_input_focus_cookie_t focus_cookie = xcb_get_input_focus(conn);
+  xcb_get_property_cookie_t client_list_cookie =
+      xcb_ewmh_get_client_list_stacking(ewmh, 0);
+
+  // Both replies come back in the same round-trip
+  xcb_ewmh_get_windows_reply_t windows;
+  x11_rt_batch_begin();
+  bool have_clients = X11_SYNC_OK(xcb_ewmh_get_client_list_stacking_reply(
+      ewmh, client_list_cookie, &windows, NULL));
+  xcb_window_t focused = XCB_NONE;
+  xcb_get_input_focus_reply_t *focus_reply =
+      X11_SYNC(xcb_get_input_focus_reply(conn, focus_cookie, NULL));
+  x11_rt_batch_end();
+  if (focus_reply) {
+    focused = focus_reply->focus;
+    free(focus_reply);
+  }
+  if (!have_clients) {
+    printf("Failed to get client list stacking\n");
+    return;
+  }
+  uint32_t len = windows.windows_len;
+
+  WindowFetch *fetch = calloc(len ? len : 1, sizeof(WindowFetch));
+  if (!fetch) {
+    xcb_ewmh_get_windows_reply_wipe(&windows);
+    return;
+  }
+  for (uint32_t i = 0; i < len; i++)
+    fetch[i].id = windows.windows[i];
+  window_list_set_clients(list, windows.windows, len);
+  xcb_ewmh_get_windows_reply_wipe(&windows);
+
+  fetch_windows(conn, ewmh, fetch, len);
+
+  // Reset window list
+  for (size_t i = 0; i < list->count; i++)
+    window_clear(&list->windows[i]);
+  list->count = 0;
+  list->version++;
+
+  // Ensure capacity
+  if (!window_list_reserve(list, len)) {
+    for (uint32_t i = 0; i < len; i++)
+      fetch_clear_props(&fetch[i]);
+    free(fetch);
+    return;
+  }
+
+  // Fill window list; ownership of the fetched strings moves to the list
+  for (uint32_t i = 0; i < len; i++) {
+    LOG("[%d]: Window title: %s", i, fetch[i].title);
+    if (!fetch_has_title(&fetch[i])) {
+      fetch_clear_props(&fetch[i]);
+      continue;
+    }
+    X11Window *w = &list->windows[list->count++];
+    window_from_fetch(w, &fetch[i]);
+    w->focused = (w->id == focused);
+  }
+  free(fetch);
+}
+
+void window_list_update(WindowList *list, xcb_connection_t *conn,
+                        xcb_ewmh_connection_t *ewmh) {
+  x11_op_enter(X11_OP_REFRESH);
+  window_list_fetch_pipelined(list, conn, ewmh);
+  x11_op_leave();
+}
+
+/*---------------------------------------------------------------------------*/
+/* Live window index                                                         */
+/*---------------------------------------------------------------------------*/
+
+static long window_list_find(const WindowList *list, xcb_window_t id) {
+  for (size_t i = 0; i < list->count; i++) {
+    if (list->windows[i].id == id)
+      return (long)i;
+  }
+  return -1;
+}
+
+static bool window_list_is_client(const WindowList *list, xcb_window_t id) {
+  for (size_t i = 0; i < list->client_count; i++) {
+    if (list->clients[i] == id)
+      return true;
+  }
+  return false;
+}
+
+static void window_list_remove_at(WindowList *list, size_t index) {
+  window_clear(&list->windows[index]);
+  memmove(&list->windows[index], &list->windows[index + 1],
+          (list->count - index - 1) * sizeof(X11Window));
+  list->count--;
+}
+
+// Inserts, replaces or drops (untitled) the entry for a fetched window
+static bool window_list_apply_fetch(WindowList *list, WindowFetch *f) {
+  long index = window_list_find(list, f->id);
+  if (!fetch_has_title(f)) {
+    fetch_clear_props(f);
+    if (index < 0)
+      return false;
+    window_list_remove_at(list, index);
+    return true;
+  }
+  if (index >= 0) {
+    X11Window *w = &list->windows[index];
+    bool focused = w->focused;
+    window_clear(w);
+    window_from_fetch(w, f);
+    w->focused = focused;
+    return true;
+  }
+  if (list->count == list->capacity &&
+      !window_list_reserve(list, list->capacity ? list->capacity * 2
+                                                : INITIAL_CAPACITY)) {
+    fetch_clear_props(f);
+    return false;
+  }
+  X11Window *w = &list->windows[list->count++];
+  window_from_fetch(w, f);
+  w->focused = (w->id == list->active);
+  return true;
+}
+
+// Restores stacking order after insertions (insertion sort: the list is
+// almost sorted and only touched when the window manager reports changes)
+static void window_list_sort_by_stacking(WindowList *list) {
+  size_t *rank = calloc(list->count ? list->count : 1, sizeof(size_t));
+  if (!rank)
+    return;
+  for (size_t i = 0; i < list->count; i++) {
+    for (size_t c = 0; c < list->client_count; c++) {
+      if (list->clients[c] == list->windows[i].id) {
+        rank[i] = c;
+        break;
+      }
+    }
+  }
+  for (size_t i = 1; i < list->count; i++) {
+    X11Window w = list->windows[i];
+    size_t r = rank[i];
+    size_t j = i;
+    while (j > 0 && rank[j - 1] > r) {
+      list->windows[j] = list->windows[j - 1];
+      rank[j] = rank[j - 1];
+      j--;
+    }
+    list->windows[j] = w;
+    rank[j] = r;
+  }
+  free(rank);
+}
+
+// Property changes only: structure events of every client would flood the
+// loop (and the queue of events deferred during a grab)
+static void watch_client(const WindowList *list, xcb_connection_t *conn,
+                         xcb_window_t window) {
+  uint32_t mask = X11_CLIENT_EVENT_MASK;
+  // Same connection as the active window tracker: keep what it selected
+  if (window == list->active)
+    mask |= X11_ACTIVE_EVENT_MASK;
+  xcb_change_window_attributes(conn, window, XCB_CW_EVENT_MASK, &mask);
+}
+
+// i3 frames carry no title; the child they were resolved to is watched too
+static void watch_title_window(const WindowList *list, xcb_connection_t *conn,
+                               const WindowFetch *f) {
+  if (f->target != XCB_NONE && f->target != f->id)
+    watch_client(list, conn, f->target);
+}
+
+// Client whose title is read from window: the window itself or, for the
+// child of an i3 frame, the frame. XCB_NONE if it is neither.
+static xcb_window_t window_list_title_owner(const WindowList *list,
+                                            xcb_connection_t *conn,
+                                            xcb_window_t window) {
+  if (window_list_is_client(list, window))
+    return window;
+  for (size_t i = 0; i < list->count; i++) {
+    if (list->windows[i].title_window == window)
+      return list->windows[i].id;
+  }
+  // The child of a frame that had no title yet, so is not listed
+  xcb_query_tree_reply_t *tree = X11_SYNC(
+      xcb_query_tree_reply(conn, xcb_query_tree(conn, window), NULL));
+  xcb_window_t parent = tree ? tree->parent : XCB_NONE;
+  free(tree);
+  return window_list_is_client(list, parent) ? parent : XCB_NONE;
+}
+
+// _NET_CLIENT_LIST_STACKING changed: drop vanished clients, fetch new ones
+static bool window_list_sync_clients(WindowList *list, xcb_connection_t *conn,
+                                     xcb_ewmh_connection_t *ewmh) {
+  xcb_ewmh_get_windows_reply_t windows;
+  if (!X11_SYNC_OK(xcb_ewmh_get_client_list_stacking_reply(
+          ewmh, xcb_ewmh_get_client_list_stacking(ewmh, 0), &windows, NULL)))
+    return false;
+
+  bool changed = false;
+  for (size_t i = list->count; i-- > 0;) {
+    bool present = false;
+    for (uint32_t c = 0; c < windows.windows_len && !present; c++)
+      present = windows.windows[c] == list->windows[i].id;
+    if (!present) {
+      window_list_remove_at(list, i);
+      changed = true;
+    }
+  }
+
+  WindowFetch *fetch = calloc(windows.windows_len ? windows.windows_len : 1,
+                              sizeof(WindowFetch));
+  size_t n = 0;
+  if (fetch) {
+    for (uint32_t c = 0; c < windows.windows_len; c++) {
+      if (!window_list_is_client(list, windows.windows[c])) {
+        fetch[n++].id = windows.windows[c];
+        watch_client(list, conn, windows.windows[c]);
+      }
+    }
+  }
+  // windows.windows is NULL for an empty list
+  if (list->client_count != windows.windows_len ||
+      (windows.windows_len > 0 &&
+       memcmp(list->clients, windows.windows,
+              sizeof(xcb_window_t) * windows.windows_len) != 0))
+    changed = true; // Restacked
+  window_list_set_clients(list, windows.windows, windows.windows_len);
+  xcb_ewmh_get_windows_reply_wipe(&windows);
+
+  if (n > 0) {
+    fetch_windows(conn, ewmh, fetch, n);
+    for (size_t i = 0; i < n; i++) {
+      watch_title_window(list, conn, &fetch[i]);
+      changed |= window_list_apply_fetch(list, &fetch[i]);
+    }
+  }
+  free(fetch);
+  if (changed)
+    window_list_sort_by_stacking(list);
+  return changed;
+}
+
+static bool window_list_sync_active(WindowList *list,
+                                    xcb_ewmh_connection_t *ewmh) {
+  xcb_window_t active = XCB_NONE;
+  if (!X11_SYNC_OK(xcb_ewmh_get_active_window_reply(
+          ewmh, xcb_ewmh_get_active_window(ewmh, 0), &active, NULL)))
+    active = XCB_NONE;
+  if (active == list->active)
+    return false;
+  list->active = active;
+  for (size_t i = 0; i < list->count; i++)
+    list->windows[i].focused = (list->windows[i].id == active);
+  return true;
+}
+
+bool window_list_watch(WindowList *list, xcb_connection_t *conn,
+                       xcb_ewmh_connection_t *ewmh, xcb_window_t root) {
+  if (!list || !conn || !ewmh)
+    return false;
+
+  // Keep whatever else is selected on the root window
+  uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+  xcb_get_window_attributes_reply_t *attrs =
+      X11_SYNC(xcb_get_window_attributes_reply(
+          conn, xcb_get_window_attributes(conn, root), NULL));
+  if (attrs) {
+    mask |= attrs->your_event_mask;
+    free(attrs);
+  }
+  xcb_change_window_attributes(conn, root, XCB_CW_EVENT_MASK, &mask);
+
+  // Start from a full snapshot; the events take it from here
+  window_list_update(list, conn, ewmh);
+  window_list_sync_active(list, ewmh);
+  for (size_t i = 0; i < list->client_count; i++)
+    watch_client(list, conn, list->clients[i]);
+  for (size_t i = 0; i < list->count; i++) {
+    if (list->windows[i].title_window != list->windows[i].id)
+      watch_client(list, conn, list->windows[i].title_window);
+  }
+  xcb_flush(conn);
+
+  list->root = root;
+  list->live = true;
+  list->version++;
+  return true;
+}
+
+bool window_list_handle_event(WindowList *list, xcb_connection_t *conn,
+                              xcb_ewmh_connection_t *ewmh,
+                              xcb_generic_event_t *event) {
+  if (!list || !list->live || !event ||
+      (event->response_type & ~0x80) != XCB_PROPERTY_NOTIFY)
+    return false;
+
+  xcb_property_notify_event_t *pn = (xcb_property_notify_event_t *)event;
+  bool changed = false;
+  x11_op_enter(X11_OP_REFRESH);
+  if (pn->window == list->root) {
+    if (pn->atom == ewmh->_NET_CLIENT_LIST_STACKING)
+      changed = window_list_sync_clients(list, conn, ewmh);
+    else if (pn->atom == ewmh->_NET_ACTIVE_WINDOW)
+      changed = window_list_sync_active(list, ewmh);
+  } else if (pn->atom == ewmh->_NET_WM_NAME ||
+             pn->atom == XCB_ATOM_WM_NAME ||
+             pn->atom == XCB_ATOM_WM_CLASS ||
+             pn->atom == ewmh->_NET_WM_DESKTOP) {
+    WindowFetch fetch = {
+        .id = window_list_title_owner(list, conn, pn->window)};
+    if (fetch.id != XCB_NONE) {
+      fetch_windows(conn, ewmh, &fetch, 1);
+      watch_title_window(list, conn, &fetch);
+      changed = window_list_apply_fetch(list, &fetch);
+      if (changed)
+        window_list_sort_by_stacking(list);
+    }
+  }
+  x11_op_leave();
+
+  if (changed) {
+    list->version++;
+    LOG("Window list changed (version %lu, %zu windows)", list->version,
+        list->count);
+  }
+  return changed;
+}
+
+/* Previous strategy: one blocking round-trip per property per window. Kept
+ * as the reference for the window list benchmark in test_performance. */
+static void window_list_fetch_sequential(WindowList *list,
+                                         xcb_connection_t *conn,
+                                         xcb_ewmh_connection_t *ewmh) {
   printf("Updating window list\n");
   // EWMH initialization is now done externally and passed in.
   if (!ewmh) {
@@ -156,8 +689,8 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
       xcb_ewmh_get_client_list_stacking(ewmh, 0); // Use passed ewmh
 
   xcb_ewmh_get_windows_reply_t windows;
-  if (!xcb_ewmh_get_client_list_stacking_reply(ewmh, client_list_cookie,
-                                               &windows, NULL)) {
+  if (!X11_SYNC_OK(xcb_ewmh_get_client_list_stacking_reply(
+          ewmh, client_list_cookie, &windows, NULL))) {
     printf("Failed to get client list stacking\n");
     // No wipe needed here, ewmh is managed externally
     return;
@@ -175,6 +708,7 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
     free(list->windows[i].name);
   }
   list->count = 0;
+  list->version++;
 
   // Ensure capacity
   if (len > list->capacity) {
@@ -201,7 +735,7 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
       xcb_query_tree_cookie_t tree_cookie =
           xcb_query_tree(conn, client_list[i]);
       xcb_query_tree_reply_t *tree_reply =
-          xcb_query_tree_reply(conn, tree_cookie, NULL);
+          X11_SYNC(xcb_query_tree_reply(conn, tree_cookie, NULL));
 
       if (tree_reply) {
         xcb_window_t *container_children = xcb_query_tree_children(tree_reply);
@@ -214,7 +748,7 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
       }
     }
 
-    char *title = get_window_title(conn, window_to_use);
+    char *title = get_window_title(conn, ewmh, window_to_use);
     LOG("[%d]: Window title: %s", i, title);
     if (!title || strcmp(title, "<Untitled>") == 0) {
       free(title);
@@ -230,12 +764,14 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
     }
 
     list->windows[list->count].id = client_list[i];
+    list->windows[list->count].title_window = window_to_use;
     list->windows[list->count].focused = (client_list[i] == focused);
 
     xcb_get_property_cookie_t desktop_cookie =
         xcb_ewmh_get_wm_desktop(ewmh, client_list[i]); // Use passed ewmh
     uint32_t desktop;
-    if (xcb_ewmh_get_wm_desktop_reply(ewmh, desktop_cookie, &desktop, NULL)) { // Use passed ewmh
+    if (X11_SYNC_OK(xcb_ewmh_get_wm_desktop_reply(ewmh, desktop_cookie,
+                                                  &desktop, NULL))) {
       list->windows[list->count].desktop = desktop;
     } else {
       list->windows[list->count].desktop = 0;
@@ -260,6 +796,13 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
   // No wipe needed here, ewmh is managed externally
 }
 
+void window_list_update_sequential(WindowList *list, xcb_connection_t *conn,
+                                   xcb_ewmh_connection_t *ewmh) {
+  x11_op_enter(X11_OP_REFRESH);
+  window_list_fetch_sequential(list, conn, ewmh);
+  x11_op_leave();
+}
+
 /* Filter the window list based on the given filter function.
  * The filter function should return true if the window should be included in
  * the filtered list, and false otherwise.
@@ -280,7 +823,7 @@ void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_conne
  */
 WindowList *window_list_filter(const WindowList *list, WindowFilterFn filter,
                                const void *filter_data) {
-  WindowList *filtered = malloc(sizeof(WindowList));
+  WindowList *filtered = calloc(1, sizeof(WindowList));
   if (!filtered)
     return NULL;
 
@@ -348,24 +891,18 @@ void window_raise(xcb_connection_t *conn, xcb_window_t window) {
   xcb_flush(conn);
 }
 
-uint32_t window_get_desktop(xcb_connection_t *conn, xcb_window_t window) {
-  xcb_ewmh_connection_t ewmh;
-  // Initialize EWMH atoms (this could be cached for efficiency)
-  xcb_intern_atom_cookie_t *cookie = xcb_ewmh_init_atoms(conn, &ewmh);
-
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, cookie, NULL)) {
-    // Clean up on failure
-    xcb_ewmh_connection_wipe(&ewmh);
-    return 0; // May want to return a special value to indicate error
-  }
+uint32_t window_get_desktop(xcb_connection_t *conn,
+                            xcb_ewmh_connection_t *ewmh, xcb_window_t window) {
+  (void)conn; // The EWMH connection carries it
+  if (!ewmh)
+    return 0;
 
   // Request the _NET_WM_DESKTOP property for the given window
   xcb_get_property_cookie_t desktop_cookie =
-      xcb_ewmh_get_wm_desktop(&ewmh, window);
+      xcb_ewmh_get_wm_desktop(ewmh, window);
   uint32_t desktop;
-  if (xcb_ewmh_get_wm_desktop_reply(&ewmh, desktop_cookie, &desktop, NULL)) {
-    // Clean up the EWMH connection data
-    xcb_ewmh_connection_wipe(&ewmh);
+  if (X11_SYNC_OK(xcb_ewmh_get_wm_desktop_reply(ewmh, desktop_cookie, &desktop,
+                                                NULL))) {
     // Check for sticky windows: EWMH defines sticky as 0xFFFFFFFF
     if (desktop == 0xFFFFFFFF) {
       // Handle sticky windows as needed (here we log it and return the value)
@@ -377,29 +914,22 @@ uint32_t window_get_desktop(xcb_connection_t *conn, xcb_window_t window) {
     return desktop;
   }
 
-  xcb_ewmh_connection_wipe(&ewmh);
   // If property is not found, consider whether 0 is a valid desktop or if
   // another sentinel should be used.
   return 0;
 }
 
-void window_activate(xcb_connection_t *conn, xcb_window_t window) {
+void window_activate(xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh,
+                     xcb_window_t window) {
   window_focus(conn, window);
   window_raise(conn, window);
+  if (!ewmh)
+    return;
   // with ewmh
   xcb_client_message_event_t event;
-  xcb_ewmh_connection_t ewmh = {0};
-  xcb_intern_atom_cookie_t *cookie = xcb_ewmh_init_atoms(conn, &ewmh);
-
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, cookie, NULL)) {
-    fprintf(stderr, "Cannot initialize EWMH atoms\n");
-    xcb_disconnect(conn);
-    exit(1);
-  }
-
   event.response_type = XCB_CLIENT_MESSAGE;
   event.window = window;
-  event.type = ewmh._NET_ACTIVE_WINDOW;
+  event.type = ewmh->_NET_ACTIVE_WINDOW;
   event.format = 32;
   event.data.data32[0] = 2; // 2 means the source is a pager
   event.data.data32[1] = XCB_CURRENT_TIME;
@@ -407,17 +937,53 @@ void window_activate(xcb_connection_t *conn, xcb_window_t window) {
   event.data.data32[3] = 0;
   LOG("Sending event");
 
-  xcb_send_event(conn, 0, ewmh._NET_WM_WINDOW_TYPE,
+  xcb_send_event(conn, 0, ewmh->_NET_WM_WINDOW_TYPE,
                  XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
                      XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
                  (char *)&event);
   xcb_flush(conn);
 }
 
+void window_activate_cached(xcb_connection_t *conn,
+                            xcb_ewmh_connection_t *ewmh, xcb_window_t window,
+                            uint32_t desktop) {
+  if (!conn || !ewmh || window == XCB_NONE)
+    return;
+  xcb_window_t root = get_root_window(conn); // From the setup, no request
+  uint32_t mask = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
+                  XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+  xcb_client_message_event_t event = {0};
+  event.response_type = XCB_CLIENT_MESSAGE;
+  event.format = 32;
+
+  // Desktop first so the window is viewable by the time it is focused
+  if (desktop != X11_DESKTOP_ALL) {
+    event.window = root;
+    event.type = ewmh->_NET_CURRENT_DESKTOP;
+    event.data.data32[0] = desktop;
+    event.data.data32[1] = XCB_CURRENT_TIME;
+    xcb_send_event(conn, 0, root, mask, (char *)&event);
+  }
+
+  event.window = window;
+  event.type = ewmh->_NET_ACTIVE_WINDOW;
+  event.data.data32[0] = 2; // 2 means the source is a pager
+  event.data.data32[1] = XCB_CURRENT_TIME;
+  event.data.data32[2] = XCB_NONE;
+  xcb_send_event(conn, 0, root, mask, (char *)&event);
+
+  uint32_t stack_mode = XCB_STACK_MODE_ABOVE;
+  xcb_configure_window(conn, window, XCB_CONFIG_WINDOW_STACK_MODE,
+                       &stack_mode);
+  xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, window,
+                      XCB_CURRENT_TIME);
+  xcb_flush(conn);
+}
+
 xcb_window_t window_get_focused(xcb_connection_t *conn) {
   xcb_get_input_focus_cookie_t cookie = xcb_get_input_focus(conn);
   xcb_get_input_focus_reply_t *reply =
-      xcb_get_input_focus_reply(conn, cookie, NULL);
+      X11_SYNC(xcb_get_input_focus_reply(conn, cookie, NULL));
 
   if (!reply)
     return XCB_NONE;
@@ -427,7 +993,7 @@ xcb_window_t window_get_focused(xcb_connection_t *conn) {
   return window;
 }
 
-void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t ewmhh,
+void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t *ewmh,
                   xcb_window_t window) {
   /* xcb_connection_t *connection = xcb_connect(NULL, NULL); */
   /* if (xcb_connection_has_error(connection)) { */
@@ -435,21 +1001,15 @@ void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t ewmhh,
   /*     exit(1); */
   /* } */
 
-  xcb_ewmh_connection_t ewmh;
-  LOG("Initializing EWMH");
-  xcb_intern_atom_cookie_t *cookie = xcb_ewmh_init_atoms(connection, &ewmh);
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, cookie, NULL)) {
-    fprintf(stderr, "Cannot initialize EWMH atoms\n");
-    xcb_disconnect(connection);
-    exit(1);
-  }
+  if (!ewmh)
+    return;
 
   /* xcb_window_t window = (xcb_window_t)window_id; */
 
   xcb_client_message_event_t event;
   event.response_type = XCB_CLIENT_MESSAGE;
   event.window = window;
-  event.type = ewmh._NET_ACTIVE_WINDOW;
+  event.type = ewmh->_NET_ACTIVE_WINDOW;
   event.format = 32;
   event.data.data32[0] = 2; // 2 means the source is a pager, 3 means the
   // source is a taskbar, 4 means the source is a user, 1 means the source is
@@ -462,7 +1022,7 @@ void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t ewmhh,
   event.data.data32[4] = 0;
   LOG("Sending event");
 
-  xcb_send_event(connection, 0, ewmh._NET_WM_WINDOW_TYPE,
+  xcb_send_event(connection, 0, ewmh->_NET_WM_WINDOW_TYPE,
                  XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
                      XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
                  (char *)&event);
@@ -481,16 +1041,11 @@ xcb_window_t get_root_window(xcb_connection_t *connection) {
 // Function: switch_to_desktop
 // Sends a _NET_CURRENT_DESKTOP client message to the root window to switch
 // desktops.
-void switch_to_desktop(xcb_connection_t *connection, uint32_t desktop) {
+void switch_to_desktop(xcb_connection_t *connection,
+                       xcb_ewmh_connection_t *ewmh, uint32_t desktop) {
   xcb_client_message_event_t event;
-  xcb_ewmh_connection_t ewmh;
-  // Initialize EWMH atoms.
-  xcb_intern_atom_cookie_t *cookie = xcb_ewmh_init_atoms(connection, &ewmh);
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, cookie, NULL)) {
-    fprintf(stderr, "Cannot initialize EWMH atoms\n");
-    xcb_disconnect(connection);
-    exit(1);
-  }
+  if (!ewmh)
+    return;
 
   // Get the root window
   xcb_window_t root = get_root_window(connection);
@@ -498,7 +1053,7 @@ void switch_to_desktop(xcb_connection_t *connection, uint32_t desktop) {
   // Prepare the client message for _NET_CURRENT_DESKTOP.
   event.response_type = XCB_CLIENT_MESSAGE;
   event.window = root; // Target is the root window.
-  event.type = ewmh._NET_CURRENT_DESKTOP;
+  event.type = ewmh->_NET_CURRENT_DESKTOP;
   event.format = 32;
   event.data.data32[0] = desktop; // The desktop number to switch to.
   event.data.data32[1] = XCB_CURRENT_TIME;
@@ -517,16 +1072,11 @@ void switch_to_desktop(xcb_connection_t *connection, uint32_t desktop) {
 // Function: switch_to_window
 // Sends a _NET_ACTIVE_WINDOW client message to the root window to focus a
 // window. Then, it determines the window's desktop and calls switch_to_desktop.
-void switch_to_window(xcb_connection_t *connection, xcb_window_t window) {
+void switch_to_window(xcb_connection_t *connection,
+                      xcb_ewmh_connection_t *ewmh, xcb_window_t window) {
   xcb_client_message_event_t event;
-  xcb_ewmh_connection_t ewmh;
-  // Initialize EWMH atoms.
-  xcb_intern_atom_cookie_t *cookie = xcb_ewmh_init_atoms(connection, &ewmh);
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, cookie, NULL)) {
-    fprintf(stderr, "Cannot initialize EWMH atoms\n");
-    xcb_disconnect(connection);
-    exit(1);
-  }
+  if (!ewmh)
+    return;
 
   // Get the root window from the default screen.
   xcb_window_t root = get_root_window(connection);
@@ -535,7 +1085,7 @@ void switch_to_window(xcb_connection_t *connection, xcb_window_t window) {
   event.response_type = XCB_CLIENT_MESSAGE;
   // Set the client message target window (typically the window to activate).
   event.window = window;
-  event.type = ewmh._NET_ACTIVE_WINDOW;
+  event.type = ewmh->_NET_ACTIVE_WINDOW;
   event.format = 32;
   event.data.data32[0] = 2; // 2 indicates the source is a pager.
   event.data.data32[1] = XCB_CURRENT_TIME;
@@ -552,9 +1102,9 @@ void switch_to_window(xcb_connection_t *connection, xcb_window_t window) {
 
   // Retrieve the desktop number associated with the window.
   // (Replace this with your actual implementation to get the desktop.)
-  uint32_t desktop = window_get_desktop(connection, window);
+  uint32_t desktop = window_get_desktop(connection, ewmh, window);
   /* /\* window_get_desktop(connection, window) *\/ 0; // <-- pseudocode */
-  switch_to_desktop(connection, desktop);
+  switch_to_desktop(connection, ewmh, desktop);
 }
 
 /* void switch_to_window(xcb_connection_t *connection, xcb_window_t window, */
@@ -9,6 +9,7 @@
 
 typedef struct {
   xcb_window_t id;
+  xcb_window_t title_window; // Title read from here (an i3 frame's child)
   char *title;
   char *className;
   char *instance;
@@ -21,8 +22,23 @@ typedef struct {
   X11Window *windows;
   size_t count;
   size_t capacity;
+  // All clients in stacking order, including untitled ones (which are not
+  // in windows[] but may gain a title later)
+  xcb_window_t *clients;
+  size_t client_count;
+  size_t client_capacity;
+  xcb_window_t root;    // Root window of a live list
+  xcb_window_t active;  // _NET_ACTIVE_WINDOW of a live list
+  bool live;            // Kept current by window_list_handle_event
+  unsigned long version; // Bumped on every change to windows[]
 } WindowList;
 
+// Event mask selected on client windows by the live window list, and what
+// the active window tracker adds on the active window only. The mask is per
+// client, so whoever changes it sets the union (see X11ActiveWindow).
+#define X11_CLIENT_EVENT_MASK XCB_EVENT_MASK_PROPERTY_CHANGE
+#define X11_ACTIVE_EVENT_MASK XCB_EVENT_MASK_STRUCTURE_NOTIFY
+
 typedef bool (*WindowFilterFn)(const X11Window *window, const void *data);
 
 typedef struct {
@@ -55,7 +71,23 @@ WindowList *window_list_init(xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh
 void window_list_free(WindowList *list);
 
 // Update window list
+// Pipelined: all per-window requests are sent before any reply is read.
 void window_list_update(WindowList *list, xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh);
+// One blocking request per property per window (benchmark reference)
+void window_list_update_sequential(WindowList *list, xcb_connection_t *conn,
+                                   xcb_ewmh_connection_t *ewmh);
+
+// Live window index: subscribe to _NET_CLIENT_LIST_STACKING and
+// _NET_ACTIVE_WINDOW on the root window plus _NET_WM_NAME, WM_NAME,
+// WM_CLASS and _NET_WM_DESKTOP on every client, then apply only the deltas
+// from the resulting PropertyNotify events. A live list never needs
+// window_list_update again.
+bool window_list_watch(WindowList *list, xcb_connection_t *conn,
+                       xcb_ewmh_connection_t *ewmh, xcb_window_t root);
+// Returns true if the event changed the list
+bool window_list_handle_event(WindowList *list, xcb_connection_t *conn,
+                              xcb_ewmh_connection_t *ewmh,
+                              xcb_generic_event_t *event);
 
 // Filter operations
 WindowList *window_list_filter(const WindowList *list, WindowFilterFn filter,
@@ -67,14 +99,29 @@ bool window_filter_substrings_all(const X11Window *window, const void *data);
 // Window operations
 void window_focus(xcb_connection_t *conn, xcb_window_t window);
 void window_raise(xcb_connection_t *conn, xcb_window_t window);
-uint32_t window_get_desktop(xcb_connection_t *conn, xcb_window_t window);
-void window_activate(xcb_connection_t *conn, xcb_window_t window);
+// The EWMH operations take the connection's already initialised atom set
+// (InputHandler/WindowMenu ewmh) and never intern atoms themselves.
+uint32_t window_get_desktop(xcb_connection_t *conn,
+                            xcb_ewmh_connection_t *ewmh, xcb_window_t window);
+void window_activate(xcb_connection_t *conn, xcb_ewmh_connection_t *ewmh,
+                     xcb_window_t window);
+// _NET_WM_DESKTOP value of windows shown on all desktops
+#define X11_DESKTOP_ALL 0xFFFFFFFF
+// Activation transaction: desktop switch (skipped for X11_DESKTOP_ALL),
+// _NET_ACTIVE_WINDOW, raise and focus are queued and sent with one flush.
+// Uses the caller's cached desktop (X11Window.desktop), so no replies are
+// waited for.
+void window_activate_cached(xcb_connection_t *conn,
+                            xcb_ewmh_connection_t *ewmh, xcb_window_t window,
+                            uint32_t desktop);
 xcb_window_t window_get_focused(xcb_connection_t *conn);
-void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t ewmh,
+void focus_window(xcb_connection_t *connection, xcb_ewmh_connection_t *ewmh,
                   xcb_window_t window);
-void switch_to_window(xcb_connection_t *connection, xcb_window_t window);
+void switch_to_window(xcb_connection_t *connection,
+                      xcb_ewmh_connection_t *ewmh, xcb_window_t window);
 
-void switch_to_desktop(xcb_connection_t *connection, uint32_t desktop);
+void switch_to_desktop(xcb_connection_t *connection,
+                       xcb_ewmh_connection_t *ewmh, uint32_t desktop);
 xcb_window_t get_root_window(xcb_connection_t *connection);
 
 #endif // X11_WINDOW_H
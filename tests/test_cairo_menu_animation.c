@@ -1,7 +1,9 @@
 /* test_cairo_menu_animation.c - Unit tests for Cairo menu animation */
 #include "../src/cairo_menu_animation.h"
+#include "../src/frame_clock.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 /* Test animation initialization */
 void test_animation_init() {
@@ -31,12 +33,6 @@ void test_animation_update() {
   printf("Menu initialized\n");
   menu.state = MENU_STATE_INITIALIZING;
 
-  printf("Getting current time\n");
-  struct timeval now;
-  printf("Current time obtained\n");
-  gettimeofday(&now, NULL);
-  data.anim.last_frame = now;
-
   printf("Showing animation\n");
   cairo_menu_animation_show(&data, &menu);
   printf("Animation shown\n");
@@ -60,10 +56,78 @@ void test_animation_update() {
   printf("Finished test_animation_update\n"); // Add debug print
 }
 
+/* Animated render target on an image surface, no X connection needed.
+ * Released with teardown_target. */
+static void setup_target(CairoMenuData *data, Menu *menu, int width,
+                         int height) {
+  memset(data, 0, sizeof(*data));
+  data->menu = menu;
+  data->render.width = width;
+  data->render.height = height;
+  data->render.surface =
+      cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  data->render.cr = cairo_create(data->render.surface);
+  data->render.font_options = cairo_font_options_create();
+  data->render.opacity = data->render.scale = 1.0;
+  cairo_menu_animation_init(data);
+}
+
+static void teardown_target(CairoMenuData *data) {
+  cairo_menu_animation_cleanup(data);
+  cairo_menu_render_cleanup(data);
+}
+
+/* Green channel below the items, where only the background shows */
+static int bottom_green(CairoMenuData *data) {
+  cairo_surface_flush(data->render.surface);
+  int stride = cairo_image_surface_get_stride(data->render.surface);
+  uint8_t *pixels = cairo_image_surface_get_data(data->render.surface);
+  return pixels[190 * stride + 100 * 4 + 1];
+}
+
+/* Test that frame clock ticks reach the screen */
+void test_animation_frames() {
+  MenuItem items[2] = {{.label = "One"}, {.label = "Two"}};
+  Menu menu;
+  memset(&menu, 0, sizeof(menu));
+  menu.config.items = items;
+  menu.config.item_count = 2;
+  menu.config.style = (MenuStyle){.background_color = {0, 1, 0, 1},
+                                  .font_face = "Mono", .font_size = 14,
+                                  .item_height = 30, .padding = 5};
+
+  CairoMenuData data;
+  setup_target(&data, &menu, 200, 200);
+
+  // Shown fully transparent until the first frame
+  cairo_menu_animation_show(&data, &menu);
+  assert(data.render.translucent && data.render.opacity == 0.0);
+  assert(cairo_menu_render_needs_update(&data));
+
+  FrameClock *clock = frame_clock_shared();
+  double last_opacity = 0.0;
+  int last_green = -1;
+  while (frame_clock_is_running(clock)) {
+    assert(frame_clock_tick(clock, frame_clock_next_deadline(clock)) > 0);
+    // Every tick fades in further and repaints the window
+    assert(data.render.opacity > last_opacity);
+    assert(!cairo_menu_render_needs_update(&data));
+    assert(bottom_green(&data) > last_green);
+    last_opacity = data.render.opacity;
+    last_green = bottom_green(&data);
+  }
+  assert(menu.state == MENU_STATE_ACTIVE);
+  assert(!data.render.translucent && data.render.opacity == 1.0);
+  assert(bottom_green(&data) > 240);
+
+  teardown_target(&data);
+}
+
 int main() {
   printf("Starting tests\n"); // Add debug print
   test_animation_init();
   test_animation_update();
+  test_animation_frames();
   printf("All tests passed.\n");
   return 0;
 }
@@ -3,6 +3,7 @@
 #include "../src/input_handler.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <xcb/xcb.h>
 
 /* Forward declaration */
@@ -23,6 +24,24 @@ static xcb_visualtype_t *get_root_visual_type(xcb_connection_t *conn) {
     return NULL;
 }
 
+/* Render target on an image surface, no X connection needed; menu may be
+ * NULL. Released with teardown_target. */
+static void setup_target(CairoMenuData *data, Menu *menu, int width,
+                         int height) {
+    memset(data, 0, sizeof(*data));
+    data->menu = menu;
+    data->render.width = width;
+    data->render.height = height;
+    data->render.surface =
+        cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    data->render.cr = cairo_create(data->render.surface);
+    data->render.font_options = cairo_font_options_create();
+}
+
+static void teardown_target(CairoMenuData *data) {
+    cairo_menu_render_cleanup(data);
+}
+
 /* Test rendering initialization */
 void test_render_init() {
     InputHandler *handler = input_handler_create();
@@ -76,11 +95,297 @@ void test_render_operations() {
     xcb_disconnect(conn);
 }
 
+/* Test damage tracking (no X connection needed) */
+void test_damage_tracking() {
+    MenuItem items[20] = {0};
+    Menu menu = {0};
+    menu.config.items = items;
+    menu.config.item_count = 20;
+    menu.config.style.padding = 5;
+    menu.config.style.font_size = 14;
+    menu.config.style.item_height = 30;
+
+    CairoMenuData data = {0};
+    data.menu = &menu;
+    data.render.width = 300;
+    assert(!cairo_menu_render_needs_update(&data));
+
+    // A selection move damages the previous and the new row only
+    cairo_menu_render_damage_row(&data, 2);
+    cairo_menu_render_damage_row(&data, 3);
+    cairo_menu_render_damage_row(&data, 3);
+    cairo_menu_render_damage_row(&data, 20); // out of range
+    cairo_menu_render_damage_row(&data, -1);
+    assert(cairo_menu_render_needs_update(&data));
+    assert(!data.render.damage.full);
+    assert(data.render.damage.row_count == 2);
+    assert(data.render.damage.rows[1].y == 5 * 2 + 14 + 3 * 30);
+    assert(data.render.damage.rows[1].height == 30);
+    assert(data.render.damage.rows[1].width == 300);
+
+    // Too many rows degrade to a full repaint
+    for (int i = 0; i < CAIRO_MENU_DAMAGE_ROWS + 1; i++)
+        cairo_menu_render_damage_row(&data, i + 4);
+    assert(data.render.damage.full);
+    assert(data.render.damage.row_count == 0);
+
+    // No context: the paint is skipped and the damage kept
+    cairo_menu_render_repaint(&data);
+    assert(cairo_menu_render_needs_update(&data));
+}
+
+/* Test scaled-font reuse (image surface, no X connection needed) */
+void test_font_cache() {
+    CairoMenuData data;
+    setup_target(&data, NULL, 100, 100);
+
+    cairo_menu_render_set_font(&data, "Mono", 14, false);
+    cairo_scaled_font_t *item = data.render.fonts[0].scaled;
+    assert(item);
+    cairo_menu_render_set_font(&data, "Mono", 14, true);
+    assert(data.render.fonts[1].scaled &&
+           data.render.fonts[1].weight == CAIRO_FONT_WEIGHT_BOLD);
+
+    // Same key: the cached font is set again, nothing is resolved
+    cairo_menu_render_set_font(&data, "Mono", 14, false);
+    assert(data.render.fonts[0].scaled == item);
+    assert(!data.render.fonts[2].scaled);
+    assert(data.render.fonts[0].last_use > data.render.fonts[1].last_use);
+
+    // Eviction keeps the cache bounded and drops the oldest entries
+    for (int i = 0; i < CAIRO_MENU_FONT_CACHE_SIZE; i++)
+        cairo_menu_render_set_font(&data, "Mono", 20 + i, false);
+    for (int i = 0; i < CAIRO_MENU_FONT_CACHE_SIZE; i++)
+        assert(data.render.fonts[i].scaled &&
+               data.render.fonts[i].size >= 20);
+
+    teardown_target(&data);
+    assert(!data.render.fonts[0].scaled && !data.render.cr);
+}
+
+/* Test glyph-run reuse and invalidation (no X connection needed) */
+void test_glyph_cache() {
+    CairoMenuData data;
+    setup_target(&data, NULL, 200, 100);
+    MenuStyle style = {.font_face = "Mono", .font_size = 14, .padding = 5};
+    char title[] = "Windows";
+
+    cairo_menu_render_title(&data, title, &style);
+    cairo_menu_render_title(&data, title, &style);
+    assert(data.render.glyphs.count == 1);
+    const CairoMenuGlyphRun *run = NULL;
+    for (size_t i = 0; i < data.render.glyphs.capacity; i++)
+        if (data.render.glyphs.runs[i].label == title)
+            run = &data.render.glyphs.runs[i];
+    assert(run && run->glyph_count == 7);
+    uint32_t hash = run->hash;
+    cairo_scaled_font_t *font = run->font;
+
+    // Same pointer, new contents: the run is rebuilt in place
+    title[0] = 'w';
+    cairo_menu_render_title(&data, title, &style);
+    assert(data.render.glyphs.count == 1 && run->hash != hash);
+
+    // New style: converted again with the new font
+    style.font_size = 20;
+    cairo_menu_render_title(&data, title, &style);
+    assert(data.render.glyphs.count == 1 && run->font != font);
+
+    teardown_target(&data);
+    assert(data.render.glyphs.count == 0 && !data.render.glyphs.runs);
+}
+
+/* Test layout from measured text (no X connection needed) */
+void test_layout() {
+    char label[64] = "Short";
+    MenuItem items[3] = {{.label = "One"}, {.label = label}, {.label = "Two"}};
+    Menu menu = {0};
+    menu.config.title = "Layout";
+    menu.config.items = items;
+    menu.config.item_count = 3;
+    menu.config.style = (MenuStyle){
+        .font_face = "Mono", .font_size = 14, .item_height = 42,
+        .padding = 10};
+
+    CairoMenuData data;
+    setup_target(&data, &menu, 100, 100);
+
+    int width = 0, height = 0;
+    cairo_menu_render_calculate_size(&data, &menu, &width, &height);
+    assert(data.layout.valid);
+    assert(width == CAIRO_MENU_MIN_WIDTH);
+    assert(height == 10 * 2 + 14 + 3 * 42 + 10);
+    assert(data.layout.rows[2].y == 10 * 2 + 14 + 2 * 42);
+    assert(data.layout.item_baseline > 0 &&
+           data.layout.item_baseline < 42 - 10);
+
+    // A label edited in place is measured again once reported
+    memset(label, 'W', sizeof(label) - 1);
+    cairo_menu_render_calculate_size(&data, &menu, &width, &height);
+    assert(width == CAIRO_MENU_MIN_WIDTH);
+    menu_text_changed(&menu);
+    cairo_menu_render_calculate_size(&data, &menu, &width, &height);
+    assert(width > CAIRO_MENU_MIN_WIDTH);
+    assert(data.layout.rows[0].width == width);
+
+    teardown_target(&data);
+    assert(!data.layout.valid && !data.layout.rows);
+}
+
+/* Test the static background layer (no X connection needed) */
+void test_background_layer() {
+    MenuItem items[3] = {{.label = "One"}, {.label = "Two"}, {.label = "Six"}};
+    Menu menu = {0};
+    menu.config.title = "Layer";
+    menu.config.items = items;
+    menu.config.item_count = 3;
+    menu.config.style = (MenuStyle){.background_color = {0, 0.1, 0.2, 1},
+                                    .font_face = "Mono", .font_size = 14,
+                                    .item_height = 42, .padding = 10};
+
+    CairoMenuData data;
+    setup_target(&data, &menu, 200, 200);
+
+    cairo_menu_render_request_update(&data);
+    cairo_menu_render_repaint(&data);
+    cairo_surface_t *layer = data.render.background;
+    assert(layer && data.render.background_width == 200);
+    unsigned long generation = data.render.background_generation;
+
+    // A selection change reuses the layer as is
+    menu.selected_index = 1;
+    cairo_menu_render_damage_row(&data, 0);
+    cairo_menu_render_damage_row(&data, 1);
+    cairo_menu_render_repaint(&data);
+    assert(data.render.background == layer);
+    assert(data.render.background_generation == generation);
+
+    // A style change redraws it, a smaller window too, in the same storage
+    menu.config.style.background_color[2] = 0.4;
+    cairo_menu_render_request_update(&data);
+    cairo_menu_render_repaint(&data);
+    assert(data.render.background_generation != generation);
+    data.render.width = 150;
+    cairo_menu_render_request_update(&data);
+    cairo_menu_render_repaint(&data);
+    assert(data.render.background_width == 150);
+    assert(data.render.background == layer);
+    assert(data.render.background_storage_width == 200);
+
+    // Opacity is recorded and applied once, to the next full frame
+    cairo_menu_render_set_opacity(&data, 0.5);
+    assert(data.render.translucent && cairo_menu_render_needs_update(&data));
+    cairo_menu_render_repaint(&data);
+    cairo_menu_render_set_opacity(&data, 0.5);
+    assert(!cairo_menu_render_needs_update(&data));
+    cairo_menu_render_damage_row(&data, 2);
+    cairo_menu_render_repaint(&data); // drawn whole while translucent
+    cairo_menu_render_set_opacity(&data, 1.0);
+    assert(!data.render.translucent && data.render.opacity == 1.0);
+
+    teardown_target(&data);
+    assert(!data.render.background);
+}
+
+/* Test row decoration sprites (no X connection needed) */
+/* Test PutImage bands: every row of an upload sent exactly once, each band
+ * within the request limit (no X connection needed) */
+void test_upload_bands() {
+    const uint32_t header = sizeof(xcb_put_image_request_t) + 4;
+    const uint32_t limits[] = {262140, 16777212, header + 3 * 1600, 8};
+    const int strides[] = {1600, 4000};
+    const int ranges[][2] = {{0, 1}, {0, 480}, {17, 1000}, {100, 0}};
+    static int covered[1100];
+
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+        for (size_t s = 0; s < sizeof(strides) / sizeof(strides[0]); s++) {
+            for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+                int y = ranges[r][0], height = ranges[r][1];
+                memset(covered, 0, sizeof(covered));
+                CairoMenuBands bands;
+                cairo_menu_render_bands_init(&bands, limits[l], strides[s], y,
+                                             height);
+                int requests = 0;
+                while (cairo_menu_render_bands_next(&bands)) {
+                    assert(bands.rows >= 1);
+                    assert(bands.rows == 1 ||
+                           header + (uint32_t)bands.rows * strides[s] <=
+                               limits[l]);
+                    for (int row = bands.row; row < bands.row + bands.rows;
+                         row++)
+                        covered[row]++;
+                    requests++;
+                }
+                for (int row = 0; row < 1100; row++)
+                    assert(covered[row] == (row >= y && row < y + height));
+                assert(requests == (height + bands.band - 1) / bands.band);
+            }
+        }
+    }
+
+    // A 400x480 frame without BIG-REQUESTS takes several requests, one
+    // with them
+    CairoMenuBands bands;
+    int requests = 0;
+    cairo_menu_render_bands_init(&bands, 262140, 1600, 0, 480);
+    while (cairo_menu_render_bands_next(&bands))
+        requests++;
+    assert(requests == 3);
+    requests = 0;
+    cairo_menu_render_bands_init(&bands, 16777212, 1600, 0, 480);
+    while (cairo_menu_render_bands_next(&bands))
+        requests++;
+    assert(requests == 1);
+}
+
+void test_sprite_cache() {
+    CairoMenuData data;
+    setup_target(&data, NULL, 300, 200);
+    MenuStyle style = {.highlight_color = {0, 0, 0.5, 0.5},
+                       .font_face = "Mono", .font_size = 14,
+                       .item_height = 42, .padding = 10};
+    MenuItem item = {.label = "Item"};
+
+    // Nuance box, shadow and selection highlight: one sprite each
+    cairo_menu_render_item(&data, &item, &style, true, 0);
+    cairo_surface_t *first[CAIRO_MENU_SPRITE_CACHE_SIZE];
+    int used = 0;
+    for (int i = 0; i < CAIRO_MENU_SPRITE_CACHE_SIZE; i++) {
+        first[i] = data.render.sprites[i].surface;
+        used += first[i] != NULL;
+    }
+    assert(used == 3);
+    assert(cairo_image_surface_get_width(data.render.sprites[0].surface) ==
+           6 * 2 + 1);
+
+    // Other rows stamp the same sprites
+    cairo_menu_render_item(&data, &item, &style, false, 42);
+    cairo_menu_render_item(&data, &item, &style, true, 84);
+    for (int i = 0; i < CAIRO_MENU_SPRITE_CACHE_SIZE; i++)
+        assert(data.render.sprites[i].surface == first[i]);
+
+    // A new highlight colour is one more sprite
+    style.highlight_color[2] = 0.8;
+    cairo_menu_render_item(&data, &item, &style, true, 0);
+    assert(data.render.sprites[3].surface &&
+           data.render.sprites[3].color[2] == 0.8);
+
+    teardown_target(&data);
+    assert(!data.render.sprites[0].surface);
+}
+
 int main() {
     printf("Test render init\n");
     /* test_render_init(); */
     /* printf("test render init done. \n test render operations.\n"); */
     /* test_render_operations(); */
+    test_damage_tracking();
+    test_font_cache();
+    test_glyph_cache();
+    test_layout();
+    test_background_layer();
+    test_sprite_cache();
+    test_upload_bands();
     printf("All tests passed.\n");
     return 0;
 }
@@ -0,0 +1,131 @@
+/* test_frame_clock.c - Fixed-rate animation pacing and frame statistics */
+#include "../src/frame_clock.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  int frames;
+  double elapsed_ms;
+  int lifetime; /* Frames before reporting finished */
+} Counter;
+
+static bool count_frames(void *user_data, double delta_ms) {
+  Counter *counter = user_data;
+  counter->frames++;
+  counter->elapsed_ms += delta_ms;
+  return counter->frames < counter->lifetime;
+}
+
+static void test_idle_clock() {
+  FrameClock clock;
+  frame_clock_init(&clock, 120);
+  assert(fabs(frame_clock_get_rate(&clock) - 120.0) < 0.1);
+  assert(!frame_clock_is_running(&clock));
+  assert(frame_clock_next_deadline(&clock) == UINT64_MAX);
+  assert(frame_clock_tick(&clock, frame_clock_now_us()) == 0);
+  assert(frame_clock_stats(&clock)->frames == 0);
+}
+
+static void test_fixed_rate_ticks() {
+  FrameClock clock;
+  frame_clock_init(&clock, 100); // 10 ms frames
+  Counter counter = {.lifetime = 100};
+  assert(frame_clock_add(&clock, count_frames, &counter));
+  assert(frame_clock_add(&clock, count_frames, &counter)); // no duplicate
+  assert(clock.count == 1);
+
+  uint64_t first = frame_clock_next_deadline(&clock);
+  assert(first != UINT64_MAX);
+  assert(frame_clock_tick(&clock, first - 1) == 0); // not due yet
+
+  // On time: one interval, next deadline one interval later
+  assert(frame_clock_tick(&clock, first) == 1);
+  assert(counter.frames == 1 && counter.elapsed_ms == 10.0);
+  assert(frame_clock_next_deadline(&clock) == first + 10000);
+
+  // Woken 25 ms late: catches up by whole frames and stays on the grid
+  assert(frame_clock_tick(&clock, first + 10000 + 25000) == 3);
+  assert(counter.elapsed_ms == 40.0);
+  assert(frame_clock_next_deadline(&clock) == first + 40000);
+
+  const FrameClockStats *stats = frame_clock_stats(&clock);
+  assert(stats->frames == 2);
+  assert(stats->missed == 2);
+  assert(stats->max_late_ms == 25.0);
+
+  char buffer[256];
+  assert(frame_clock_stats_format(&clock, buffer, sizeof(buffer)) > 0);
+  assert(strstr(buffer, "Frames: 2 at 100 Hz, 2 missed"));
+
+  frame_clock_remove(&clock, &counter);
+  assert(!frame_clock_is_running(&clock));
+  frame_clock_stats_reset(&clock);
+  assert(frame_clock_stats(&clock)->frames == 0);
+}
+
+static void test_finished_animators_stop_the_clock() {
+  FrameClock clock;
+  frame_clock_init(&clock, 60);
+  Counter short_lived = {.lifetime = 1}, long_lived = {.lifetime = 3};
+  frame_clock_add(&clock, count_frames, &short_lived);
+  frame_clock_add(&clock, count_frames, &long_lived);
+
+  uint64_t now = frame_clock_next_deadline(&clock);
+  for (int i = 0; i < 3; i++) {
+    assert(frame_clock_tick(&clock, now) == 1);
+    now = frame_clock_next_deadline(&clock);
+  }
+  assert(short_lived.frames == 1 && long_lived.frames == 3);
+  assert(!frame_clock_is_running(&clock));
+  assert(frame_clock_next_deadline(&clock) == UINT64_MAX);
+}
+
+static void test_drives_menu_animations() {
+  FrameClock clock;
+  frame_clock_init(&clock, 50); // 20 ms frames
+  MenuAnimation *anim = menu_animation_fade_in(100);
+  menu_animation_start(anim);
+  assert(frame_clock_add_animation(&clock, anim));
+
+  // Same steps regardless of when the loop wakes: 100 ms is five frames
+  uint64_t now = frame_clock_next_deadline(&clock);
+  int ticks = 0;
+  while (frame_clock_is_running(&clock)) {
+    ticks += frame_clock_tick(&clock, now);
+    now = frame_clock_next_deadline(&clock);
+  }
+  assert(ticks == 5);
+  assert(!menu_animation_is_running(anim));
+  assert(menu_animation_get_opacity(anim) == 1.0);
+  menu_animation_destroy(anim);
+
+  MenuAnimationSequence *seq = menu_animation_sequence_create();
+  menu_animation_sequence_add(seq, menu_animation_fade_in(40));
+  menu_animation_sequence_start(seq);
+  assert(frame_clock_add_sequence(&clock, seq));
+  now = frame_clock_next_deadline(&clock);
+  while (frame_clock_is_running(&clock)) {
+    frame_clock_tick(&clock, now);
+    now = frame_clock_next_deadline(&clock);
+  }
+  assert(!menu_animation_sequence_is_running(seq));
+  menu_animation_sequence_destroy(seq);
+}
+
+static void test_shared_clock() {
+  FrameClock *clock = frame_clock_shared();
+  assert(clock == frame_clock_shared());
+  assert(fabs(frame_clock_get_rate(clock) - FRAME_CLOCK_DEFAULT_HZ) < 0.1);
+}
+
+int main() {
+  test_idle_clock();
+  test_fixed_rate_ticks();
+  test_finished_animators_stop_the_clock();
+  test_drives_menu_animations();
+  test_shared_clock();
+  printf("All frame_clock tests passed.\n");
+  return 0;
+}
@@ -1,4 +1,5 @@
 /* test_menu.c - Unit tests for menu functionality */
+#include "../src/frame_clock.h"
 #include "../src/menu.h"
 #include <assert.h>
 #include <unistd.h> // For usleep
@@ -24,6 +25,18 @@ static void test_action(void *user_data) {
   (void)user_data; /* Suppress unused parameter warning */
 }
 
+/* Selection callback counter and the index it last saw */
+static int selections = 0;
+static int selected_seen = -1;
+static Menu *selection_menu = NULL;
+
+static void count_selection(MenuItem *item, void *user_data) {
+  (void)item;
+  (void)user_data;
+  selections++;
+  selected_seen = selection_menu->selected_index;
+}
+
 /* Initialize mock X11 environment */
 static MockX11 setup_mock_x11(void) {
   MockX11 mock = {0};
@@ -210,12 +223,65 @@ static void test_menu_activation(void) {
 }
 
 /* Run all tests */
+/* Test key-repeat bursts: on_select (and the repaint it carries) runs at
+ * most once per frame, for the selection the burst ended on */
+static void test_selection_per_frame(void) {
+  printf("Testing selection per frame...\n");
+
+  MenuItem items[4] = {{.label = "One"}, {.label = "Two"},
+                       {.label = "Three"}, {.label = "Four"}};
+  Menu menu = {0};
+  menu.config.items = items;
+  menu.config.item_count = 4;
+  menu.active = true;
+  menu.on_select = count_selection;
+  menu.user_data = NULL; // No window: nothing to paint
+  selection_menu = &menu;
+  FrameClock *clock = frame_clock_shared();
+
+  // All moves within one frame only record the selection
+  for (int i = 0; i < 6; i++)
+    menu_select_next(&menu);
+  menu_select_prev(&menu);
+  assert(selections == 0);
+  assert(menu.selection_pending);
+
+  // The next frame applies the final one, once
+  frame_clock_tick(clock, frame_clock_next_deadline(clock));
+  assert(selections == 1);
+  assert(selected_seen == (6 - 1) % 4);
+  assert(!menu.selection_pending);
+
+  // Frames without changes apply nothing
+  assert(frame_clock_tick(clock, frame_clock_now_us() + 100000) == 0);
+  assert(selections == 1);
+
+  // Each frame is bounded on its own
+  for (int frame = 0; frame < 3; frame++) {
+    for (int i = 0; i < 5; i++)
+      menu_select_next(&menu);
+    frame_clock_tick(clock, frame_clock_next_deadline(clock));
+    assert(selections == 2 + frame);
+    assert(selected_seen == menu.selected_index);
+  }
+
+  // Flushing (hide, confirm) applies it without waiting for the frame
+  menu_select_next(&menu);
+  menu_flush_selection(&menu);
+  assert(selections == 5);
+  assert(frame_clock_tick(clock, frame_clock_now_us() + 100000) == 0);
+  assert(selections == 5);
+
+  printf("Selection per frame test passed\n");
+}
+
 int main(void) {
   printf("Running menu tests...\n\n");
 
   test_menu_lifecycle();
   test_menu_navigation();
   test_menu_activation();
+  test_selection_per_frame();
 
   printf("\nAll menu tests passed!\n");
   return 0;
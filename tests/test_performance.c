@@ -1,8 +1,11 @@
 /* test_performance.c - Performance benchmarks for menu system */
 #include "../src/cairo_menu.h"
+#include "../src/cairo_menu_render.h"
 #include "../src/input_handler.h"
 #include "../src/menu.h"
+#include "../src/menu_defaults.h"
 #include "../src/menu_manager.h"
+#include "../src/x11_window.h"
 #include <X11/keysym.h>
 #include <assert.h>
 #include <stdio.h>
@@ -15,6 +18,10 @@
 #define BENCH_ITERATIONS 1000
 #define MENU_ITEMS 100
 #define WARMUP_ITERATIONS 10
+#define BENCH_CLIENTS 150
+#define BENCH_REFRESHES 20
+#define BENCH_FRAMES 200
+#define BENCH_OPACITY_FRAMES 10
 
 /* Timer utilities */
 typedef struct {
@@ -189,6 +196,257 @@ static void benchmark_input_handling(MockX11 *mock) {
   input_handler_destroy(handler);
 }
 
+/* Publish BENCH_CLIENTS fake clients in _NET_CLIENT_LIST_STACKING */
+static xcb_window_t *create_benchmark_clients(MockX11 *mock) {
+  xcb_window_t *clients = calloc(BENCH_CLIENTS, sizeof(xcb_window_t));
+  for (int i = 0; i < BENCH_CLIENTS; i++) {
+    char title[32];
+    snprintf(title, sizeof(title), "Client %d", i);
+    clients[i] = xcb_generate_id(mock->conn);
+    xcb_create_window(mock->conn, XCB_COPY_FROM_PARENT, clients[i], mock->root,
+                      0, 0, 10, 10, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      mock->screen->root_visual, 0, NULL);
+    xcb_ewmh_set_wm_name(&mock->ewmh, clients[i], strlen(title), title);
+    xcb_change_property(mock->conn, XCB_PROP_MODE_REPLACE, clients[i],
+                        XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, 12,
+                        "bench\0Bench\0");
+    xcb_ewmh_set_wm_desktop(&mock->ewmh, clients[i], i % 4);
+  }
+  xcb_ewmh_set_client_list_stacking(&mock->ewmh, 0, BENCH_CLIENTS, clients);
+  free(xcb_get_input_focus_reply(mock->conn, xcb_get_input_focus(mock->conn),
+                                 NULL)); // sync
+  return clients;
+}
+
+/* Benchmark sequential vs. pipelined window list refresh */
+static void benchmark_window_list_update(MockX11 *mock) {
+  printf("Benchmarking window list refresh (%d clients)...\n", BENCH_CLIENTS);
+
+  xcb_window_t *clients = create_benchmark_clients(mock);
+  WindowList *list = window_list_init(mock->conn, &mock->ewmh);
+  assert(list && list->count == BENCH_CLIENTS);
+
+  Timer timer;
+  double sequential = 0.0, pipelined = 0.0;
+  for (int i = 0; i < BENCH_REFRESHES; i++) {
+    timer_start(&timer);
+    window_list_update_sequential(list, mock->conn, &mock->ewmh);
+    sequential += timer_end(&timer);
+    assert(list->count == BENCH_CLIENTS);
+
+    timer_start(&timer);
+    window_list_update(list, mock->conn, &mock->ewmh);
+    pipelined += timer_end(&timer);
+    assert(list->count == BENCH_CLIENTS);
+  }
+
+  printf("Average sequential refresh time: %.3f ms\n",
+         sequential / BENCH_REFRESHES);
+  printf("Average pipelined refresh time: %.3f ms\n",
+         pipelined / BENCH_REFRESHES);
+
+  window_list_free(list);
+  xcb_delete_property(mock->conn, mock->root,
+                      mock->ewmh._NET_CLIENT_LIST_STACKING);
+  for (int i = 0; i < BENCH_CLIENTS; i++)
+    xcb_destroy_window(mock->conn, clients[i]);
+  xcb_flush(mock->conn);
+  free(clients);
+}
+
+static xcb_visualtype_t *root_visual_type(MockX11 *mock) {
+  xcb_depth_iterator_t depth_iter =
+      xcb_screen_allowed_depths_iterator(mock->screen);
+  for (; depth_iter.rem; xcb_depth_next(&depth_iter)) {
+    xcb_visualtype_iterator_t visual_iter =
+        xcb_depth_visuals_iterator(depth_iter.data);
+    for (; visual_iter.rem; xcb_visualtype_next(&visual_iter))
+      if (visual_iter.data->visual_id == mock->screen->root_visual)
+        return visual_iter.data;
+  }
+  return NULL;
+}
+
+/* Items labelled "Menu Item 1" to "Menu Item <count>" */
+static MenuItem *create_items(int count) {
+  MenuItem *items = calloc(count, sizeof(MenuItem));
+  for (int i = 0; i < count; i++) {
+    char *label = malloc(32);
+    snprintf(label, 32, "Menu Item %d", i + 1);
+    items[i].label = label;
+  }
+  return items;
+}
+
+static void free_items(MenuItem *items, int count) {
+  for (int i = 0; i < count; i++)
+    free((char *)items[i].label);
+  free(items);
+}
+
+/* How draw_menu applies opacity */
+typedef enum {
+  BENCH_OPAQUE,      /* No group */
+  BENCH_ITEM_GROUPS, /* As it used to be: every item composites the whole
+                        target once more through an (empty) group */
+  BENCH_FRAME_GROUP, /* Per-frame model: one group around the frame */
+} BenchOpacity;
+
+/* A full frame through the same drawing calls whatever the opacity model,
+ * so the groups are all that differs between the variants */
+static void draw_menu(CairoMenuData *data, const Menu *menu,
+                      BenchOpacity opacity) {
+  const MenuStyle *style = &menu->config.style;
+  cairo_t *cr = data->render.cr;
+  cairo_save(cr);
+  if (opacity == BENCH_FRAME_GROUP)
+    cairo_push_group(cr);
+  cairo_menu_render_clear(data, style);
+  cairo_menu_render_title(data, menu->config.title, style);
+  for (size_t i = 0; i < menu->config.item_count; i++) {
+    cairo_menu_render_item(data, &menu->config.items[i], style,
+                           (int)i == menu->selected_index,
+                           data->layout.rows[i].y);
+    if (opacity == BENCH_ITEM_GROUPS) {
+      cairo_push_group(cr);
+      cairo_pop_group_to_source(cr);
+      cairo_paint_with_alpha(cr, 0.5);
+    }
+  }
+  if (opacity == BENCH_FRAME_GROUP) {
+    cairo_pop_group_to_source(cr);
+    cairo_paint_with_alpha(cr, 0.5);
+  }
+  cairo_restore(cr);
+}
+
+/* Average time to present one frame of menu, including the server side of
+ * the upload (each present ends with a sync). The menu is painted into the
+ * back buffer first, outside the timing. */
+static double time_frames(MockX11 *mock, CairoMenuData *data,
+                          const Menu *menu) {
+  Timer timer;
+  double total_time = 0.0;
+  for (int i = 0; i < WARMUP_ITERATIONS + BENCH_FRAMES; i++) {
+    cairo_menu_render_begin(data);
+    draw_menu(data, menu, BENCH_OPAQUE);
+    timer_start(&timer);
+    cairo_menu_render_end(data);
+    free(xcb_get_input_focus_reply(
+        mock->conn, xcb_get_input_focus(mock->conn), NULL)); // sync
+    double elapsed = timer_end(&timer);
+    if (i >= WARMUP_ITERATIONS)
+      total_time += elapsed;
+  }
+  return total_time / BENCH_FRAMES;
+}
+
+/* Benchmark PutImage vs. MIT-SHM frame uploads at several menu sizes */
+static void benchmark_frame_upload(MockX11 *mock) {
+  printf("Benchmarking frame upload...\n");
+
+  X11FocusContext *ctx = x11_focus_init(mock->conn, mock->root, &mock->ewmh);
+  CairoMenuData data = {0};
+  if (!cairo_menu_render_init(&data, mock->conn, mock->screen, mock->root, ctx,
+                              root_visual_type(mock)) ||
+      data.render.upload == CAIRO_MENU_UPLOAD_DIRECT) {
+    printf("No back buffer for this visual, skipped\n");
+    goto out;
+  }
+
+  const int sizes[] = {10, 50, 200};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    MenuItem *items = create_items(sizes[i]);
+    Menu menu = {0};
+    menu.config.title = "Benchmark Menu";
+    menu.config.items = items;
+    menu.config.item_count = sizes[i];
+    menu.config.style = menu_style_default();
+    data.menu = &menu;
+    int width = 0, height = 0;
+    cairo_menu_render_calculate_size(&data, &menu, &width, &height);
+    cairo_menu_render_resize(&data, width, height);
+
+    assert(cairo_menu_render_set_upload(&data, CAIRO_MENU_UPLOAD_PUT_IMAGE));
+    double put_image = time_frames(mock, &data, &menu);
+    printf("%3d items (%dx%d): PutImage %.3f ms/frame", sizes[i], width,
+           height, put_image);
+    if (cairo_menu_render_set_upload(&data, CAIRO_MENU_UPLOAD_SHM))
+      printf(", MIT-SHM %.3f ms/frame\n", time_frames(mock, &data, &menu));
+    else
+      printf(", MIT-SHM unavailable\n");
+    data.menu = NULL;
+    free_items(items, sizes[i]);
+  }
+
+out:
+  cairo_menu_render_cleanup(&data);
+  x11_focus_cleanup(ctx);
+}
+
+/* Window-sized render target on an image surface, laid out for menu.
+ * Released with teardown_image_target. */
+static void setup_image_target(CairoMenuData *data, Menu *menu, int width,
+                               int height) {
+  memset(data, 0, sizeof(*data));
+  data->menu = menu;
+  data->render.width = width;
+  data->render.height = height;
+  data->render.opacity = 1.0;
+  data->render.surface =
+      cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  data->render.cr = cairo_create(data->render.surface);
+  data->render.font_options = cairo_font_options_create();
+  cairo_menu_render_update_layout(data, menu);
+}
+
+static void teardown_image_target(CairoMenuData *data) {
+  cairo_menu_render_cleanup(data);
+}
+
+/* Benchmark per-item opacity groups vs. one group per frame. Drawn on a
+ * window-sized image surface, so no server time is included; every variant
+ * is drawn once before timing so they all find the font and glyph caches
+ * warm. */
+static void benchmark_item_opacity(void) {
+  printf("Benchmarking frame opacity...\n");
+
+  const int sizes[] = {10, 100, 1000};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+    int count = sizes[n];
+    MenuItem *items = create_items(count);
+    Menu menu = {0};
+    menu.config.title = "Benchmark Menu";
+    menu.config.items = items;
+    menu.config.item_count = count;
+    menu.config.style = menu_style_default();
+
+    CairoMenuData data;
+    setup_image_target(&data, &menu, 400, 800);
+
+    double total[BENCH_FRAME_GROUP + 1] = {0.0};
+    Timer timer;
+    for (int i = -1; i < BENCH_OPACITY_FRAMES; i++) {
+      for (int m = BENCH_OPAQUE; m <= BENCH_FRAME_GROUP; m++) {
+        timer_start(&timer);
+        draw_menu(&data, &menu, m);
+        cairo_surface_flush(data.render.surface);
+        double elapsed = timer_end(&timer);
+        if (i >= 0) // The first round only warms the caches
+          total[m] += elapsed;
+      }
+    }
+    printf("%4d items: opaque %.3f ms/frame, per-item groups %.3f ms/frame, "
+           "per-frame group %.3f ms/frame\n",
+           count, total[BENCH_OPAQUE] / BENCH_OPACITY_FRAMES,
+           total[BENCH_ITEM_GROUPS] / BENCH_OPACITY_FRAMES,
+           total[BENCH_FRAME_GROUP] / BENCH_OPACITY_FRAMES);
+
+    teardown_image_target(&data);
+    free_items(items, count);
+  }
+}
+
 /* Run all benchmarks */
 int main(void) {
   printf("\nRunning Performance Benchmarks\n");
@@ -205,6 +463,15 @@ int main(void) {
   benchmark_input_handling(&mock);
   printf("\n");
 
+  benchmark_window_list_update(&mock);
+  printf("\n");
+
+  benchmark_frame_upload(&mock);
+  printf("\n");
+
+  benchmark_item_opacity();
+  printf("\n");
+
   cleanup_mock_x11(&mock);
   return 0;
 }
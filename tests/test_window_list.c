@@ -0,0 +1,183 @@
+/* test_window_list.c - Live window index driven by PropertyNotify */
+#include "../src/x11_window.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xcb_icccm.h>
+
+typedef struct {
+  xcb_connection_t *conn;
+  xcb_screen_t *screen;
+  xcb_ewmh_connection_t ewmh;
+} TestX11;
+
+static TestX11 setup_x11(void) {
+  TestX11 x = {0};
+  x.conn = xcb_connect(NULL, NULL);
+  assert(!xcb_connection_has_error(x.conn));
+  x.screen = xcb_setup_roots_iterator(xcb_get_setup(x.conn)).data;
+  assert(xcb_ewmh_init_atoms_replies(&x.ewmh,
+                                     xcb_ewmh_init_atoms(x.conn, &x.ewmh),
+                                     NULL));
+  return x;
+}
+
+static xcb_window_t create_client(TestX11 *x, const char *title) {
+  xcb_window_t win = xcb_generate_id(x->conn);
+  xcb_create_window(x->conn, XCB_COPY_FROM_PARENT, win, x->screen->root, 0, 0,
+                    10, 10, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    x->screen->root_visual, 0, NULL);
+  xcb_ewmh_set_wm_name(&x->ewmh, win, strlen(title), title);
+  return win;
+}
+
+static uint32_t event_mask_of(TestX11 *x, xcb_window_t window) {
+  xcb_get_window_attributes_reply_t *attrs = xcb_get_window_attributes_reply(
+      x->conn, xcb_get_window_attributes(x->conn, window), NULL);
+  assert(attrs);
+  uint32_t mask = attrs->your_event_mask;
+  free(attrs);
+  return mask;
+}
+
+#define PUMP_TIMEOUT_MS 2000
+
+static long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// Feeds PropertyNotify events to the list until it reports a change; fails
+// instead of hanging if none comes within PUMP_TIMEOUT_MS
+static void pump_until_changed(TestX11 *x, WindowList *list) {
+  xcb_flush(x->conn);
+  struct pollfd pfd = {.fd = xcb_get_file_descriptor(x->conn),
+                       .events = POLLIN};
+  long deadline = now_ms() + PUMP_TIMEOUT_MS;
+  for (;;) {
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(x->conn))) {
+      bool changed = window_list_handle_event(list, x->conn, &x->ewmh, event);
+      free(event);
+      if (changed)
+        return;
+    }
+    assert(!xcb_connection_has_error(x->conn));
+    long remaining = deadline - now_ms();
+    assert(remaining > 0 && "no window list change before the deadline");
+    poll(&pfd, 1, (int)remaining);
+  }
+}
+
+static void test_live_updates(void) {
+  TestX11 x = setup_x11();
+  xcb_window_t clients[3];
+  clients[0] = create_client(&x, "alpha");
+  clients[1] = create_client(&x, "beta");
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 2, clients);
+
+  WindowList *list = window_list_init(x.conn, &x.ewmh);
+  assert(window_list_watch(list, x.conn, &x.ewmh, x.screen->root));
+  assert(list->live && list->count == 2);
+  unsigned long version = list->version;
+  // Only property changes: no ConfigureNotify for every client
+  assert(event_mask_of(&x, clients[0]) == XCB_EVENT_MASK_PROPERTY_CHANGE);
+
+  // Title change of a watched client
+  xcb_ewmh_set_wm_name(&x.ewmh, clients[1], 5, "gamma");
+  pump_until_changed(&x, list);
+  assert(list->version > version);
+  assert(strstr(list->windows[1].title, "gamma"));
+
+  // New client appended to the stacking list
+  clients[2] = create_client(&x, "delta");
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 3, clients);
+  pump_until_changed(&x, list);
+  assert(list->count == 3 && list->windows[2].id == clients[2]);
+
+  // Client removed
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 2, &clients[1]);
+  pump_until_changed(&x, list);
+  assert(list->count == 2 && list->windows[0].id == clients[1]);
+
+  // Active window tracked without a full refresh
+  xcb_change_property(x.conn, XCB_PROP_MODE_REPLACE, x.screen->root,
+                      x.ewmh._NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 32, 1,
+                      &clients[2]);
+  pump_until_changed(&x, list);
+  assert(!list->windows[0].focused && list->windows[1].focused);
+
+  window_list_free(list);
+  xcb_delete_property(x.conn, x.screen->root, x.ewmh._NET_CLIENT_LIST_STACKING);
+  xcb_delete_property(x.conn, x.screen->root, x.ewmh._NET_ACTIVE_WINDOW);
+  for (int i = 0; i < 3; i++)
+    xcb_destroy_window(x.conn, clients[i]);
+  xcb_ewmh_connection_wipe(&x.ewmh);
+  xcb_disconnect(x.conn);
+}
+
+// i3 wraps clients in an untitled "i3-frame" window; the title is read from
+// (and followed on) its child
+static void test_frame_titles(void) {
+  TestX11 x = setup_x11();
+  xcb_window_t frames[2], children[2];
+  for (int i = 0; i < 2; i++) {
+    frames[i] = xcb_generate_id(x.conn);
+    xcb_create_window(x.conn, XCB_COPY_FROM_PARENT, frames[i], x.screen->root,
+                      0, 0, 10, 10, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      x.screen->root_visual, 0, NULL);
+    xcb_icccm_set_wm_class(x.conn, frames[i], 18, "i3-frame\0i3-frame\0");
+    children[i] = xcb_generate_id(x.conn);
+    xcb_create_window(x.conn, XCB_COPY_FROM_PARENT, children[i], frames[i], 0,
+                      0, 10, 10, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      x.screen->root_visual, 0, NULL);
+  }
+  xcb_ewmh_set_wm_name(&x.ewmh, children[0], 5, "alpha");
+
+  // An empty client list first
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 0, NULL);
+  WindowList *list = window_list_init(x.conn, &x.ewmh);
+  assert(window_list_watch(list, x.conn, &x.ewmh, x.screen->root));
+  assert(list->count == 0);
+
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 2, frames);
+  pump_until_changed(&x, list);
+  assert(list->count == 1 && list->windows[0].id == frames[0]);
+  assert(list->windows[0].title_window == children[0]);
+
+  // Title change on the child of a listed frame
+  xcb_ewmh_set_wm_name(&x.ewmh, children[0], 4, "beta");
+  pump_until_changed(&x, list);
+  assert(strstr(list->windows[0].title, "beta"));
+
+  // The child of an untitled (so unlisted) frame gets a title
+  xcb_ewmh_set_wm_name(&x.ewmh, children[1], 5, "gamma");
+  pump_until_changed(&x, list);
+  assert(list->count == 2 && list->windows[1].id == frames[1]);
+  assert(strstr(list->windows[1].title, "gamma"));
+
+  // Emptied again
+  xcb_ewmh_set_client_list_stacking(&x.ewmh, 0, 0, NULL);
+  pump_until_changed(&x, list);
+  assert(list->count == 0);
+
+  window_list_free(list);
+  xcb_delete_property(x.conn, x.screen->root, x.ewmh._NET_CLIENT_LIST_STACKING);
+  for (int i = 0; i < 2; i++)
+    xcb_destroy_window(x.conn, frames[i]);
+  xcb_ewmh_connection_wipe(&x.ewmh);
+  xcb_disconnect(x.conn);
+}
+
+int main(void) {
+  test_live_updates();
+  test_frame_titles();
+  printf("All window_list tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include "../src/x11_atoms.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+static xcb_atom_t intern_direct(xcb_connection_t *conn, const char *name) {
+  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+      conn, xcb_intern_atom(conn, 0, strlen(name), name), NULL);
+  assert(reply);
+  xcb_atom_t atom = reply->atom;
+  free(reply);
+  return atom;
+}
+
+static void test_batch_matches_direct_intern() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(conn && !xcb_connection_has_error(conn));
+
+  assert(x11_atoms_init(conn));
+  for (int i = 0; i < X11_ATOM_COUNT; i++) {
+    xcb_atom_t cached = x11_atom(conn, (X11AtomId)i);
+    assert(cached != XCB_NONE);
+    assert(cached == intern_direct(conn, x11_atom_name((X11AtomId)i)));
+  }
+  assert(x11_atom(conn, X11_ATOM_COUNT) == XCB_NONE);
+
+  x11_atoms_reset();
+  xcb_disconnect(conn);
+}
+
+static void test_lazy_init() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(conn && !xcb_connection_has_error(conn));
+
+  // No explicit init: first lookup interns the batch
+  x11_atoms_reset();
+  assert(x11_atom(conn, X11_ATOM_MOTIF_WM_HINTS) ==
+         intern_direct(conn, "_MOTIF_WM_HINTS"));
+  assert(x11_atom(NULL, X11_ATOM_MOTIF_WM_HINTS) == XCB_NONE);
+
+  x11_atoms_reset();
+  xcb_disconnect(conn);
+}
+
+int main() {
+  test_batch_matches_direct_intern();
+  test_lazy_init();
+  printf("All x11_atoms tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,288 @@
+/* test_x11_focus.c - Grab retry, deferred events and grab statistics */
+#include "../src/x11_focus.h"
+#include "../src/x11_window.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static xcb_window_t root_of(xcb_connection_t *conn) {
+  return xcb_setup_roots_iterator(xcb_get_setup(conn)).data->root;
+}
+
+#define NOISE_INTERVAL_MS 20
+
+/* Another client holding the keyboard: grabs it from a child process and
+ * keeps it for hold_ms, or until the parent closes release_fd if negative.
+ * A noisy holder changes a root window property every NOISE_INTERVAL_MS
+ * meanwhile. */
+static pid_t hold_keyboard(int hold_ms, bool noisy, int *release_fd) {
+  int ready[2], release[2];
+  assert(pipe(ready) == 0 && pipe(release) == 0);
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    close(ready[0]);
+    close(release[1]);
+    xcb_connection_t *conn = xcb_connect(NULL, NULL);
+    xcb_grab_keyboard_reply_t *reply = xcb_grab_keyboard_reply(
+        conn,
+        xcb_grab_keyboard(conn, 1, root_of(conn), XCB_CURRENT_TIME,
+                          XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC),
+        NULL);
+    char ok = reply && reply->status == XCB_GRAB_STATUS_SUCCESS;
+    free(reply);
+    if (write(ready[1], &ok, 1) != 1)
+      _exit(1);
+    if (hold_ms >= 0) {
+      usleep(hold_ms * 1000);
+    } else {
+      struct pollfd pfd = {.fd = release[0], .events = POLLIN};
+      uint32_t count = 0;
+      while (poll(&pfd, 1, noisy ? NOISE_INTERVAL_MS : -1) == 0) {
+        count++;
+        xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root_of(conn),
+                            XCB_ATOM_CUT_BUFFER0, XCB_ATOM_INTEGER, 32, 1,
+                            &count);
+        xcb_flush(conn);
+      }
+    }
+    xcb_disconnect(conn); // Releases the grab
+    _exit(0);
+  }
+  close(ready[1]);
+  close(release[0]);
+  char ok = 0;
+  assert(read(ready[0], &ok, 1) == 1 && ok);
+  close(ready[0]);
+  *release_fd = release[1];
+  return pid;
+}
+
+static void release_keyboard(pid_t pid, int release_fd) {
+  close(release_fd);
+  int status;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void test_grab_waits_for_release() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(!xcb_connection_has_error(conn));
+  X11FocusContext *ctx = x11_focus_init(conn, root_of(conn), NULL);
+  assert(ctx);
+
+  // Released after 200 ms: the retries pick the keyboard up well before
+  // the deadline
+  int release_fd;
+  pid_t holder = hold_keyboard(200, false, &release_fd);
+  uint64_t start = now_us();
+  assert(x11_grab_inputs(ctx, ctx->root));
+  uint64_t elapsed = now_us() - start;
+  assert(elapsed < (uint64_t)X11_GRAB_DEADLINE_MS * 1000);
+
+  const X11GrabStats *stats = x11_focus_get_grab_stats(ctx);
+  assert(stats->failures == 0);
+  assert(stats->grabs == 2);     // Keyboard after the wait, then pointer
+  assert(stats->attempts >= 3);  // At least one retry for the keyboard
+  assert(stats->max_us >= 100000);
+  x11_release_inputs(ctx);
+  release_keyboard(holder, release_fd);
+
+  x11_focus_cleanup(ctx);
+  xcb_disconnect(conn);
+}
+
+static void test_grab_gives_up_at_deadline() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(!xcb_connection_has_error(conn));
+  X11FocusContext *ctx = x11_focus_init(conn, root_of(conn), NULL);
+
+  // Never released while we wait: retried every X11_GRAB_FALLBACK_MS at
+  // most, then given up once X11_GRAB_DEADLINE_MS has passed
+  int release_fd;
+  pid_t holder = hold_keyboard(-1, false, &release_fd);
+  uint64_t start = now_us();
+  assert(!x11_grab_inputs(ctx, ctx->root));
+  uint64_t elapsed = now_us() - start;
+  assert(elapsed >= (uint64_t)X11_GRAB_DEADLINE_MS * 1000);
+  assert(elapsed < (uint64_t)X11_GRAB_DEADLINE_MS * 2000);
+
+  const X11GrabStats *stats = x11_focus_get_grab_stats(ctx);
+  assert(stats->grabs == 0 && stats->failures == 1);
+  assert(stats->attempts >= X11_GRAB_DEADLINE_MS / X11_GRAB_FALLBACK_MS / 2);
+  assert(stats->attempts <= X11_GRAB_DEADLINE_MS / X11_GRAB_FALLBACK_MS + 2);
+  release_keyboard(holder, release_fd);
+
+  // A single attempt fails at once
+  holder = hold_keyboard(-1, false, &release_fd);
+  start = now_us();
+  assert(!x11_grab_inputs_once(ctx, ctx->root));
+  assert(now_us() - start < (uint64_t)X11_GRAB_FALLBACK_MS * 1000);
+  assert(stats->failures == 2);
+  release_keyboard(holder, release_fd);
+
+  // Unrelated events we listen to (root property changes) arrive all the
+  // time while waiting; they do not make for more retries
+  uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+  xcb_change_window_attributes(conn, ctx->root, XCB_CW_EVENT_MASK, &mask);
+  holder = hold_keyboard(-1, true, &release_fd);
+  unsigned long attempts = stats->attempts;
+  assert(!x11_grab_inputs(ctx, ctx->root));
+  assert(stats->attempts - attempts <=
+         X11_GRAB_DEADLINE_MS / X11_GRAB_FALLBACK_MS + 2);
+  assert(x11_focus_has_deferred_events(ctx)); // Kept for the event loop
+  release_keyboard(holder, release_fd);
+
+  x11_focus_cleanup(ctx);
+  xcb_disconnect(conn);
+}
+
+static xcb_window_t create_window(xcb_connection_t *conn, int16_t x, int16_t y) {
+  xcb_window_t window = xcb_generate_id(conn);
+  xcb_create_window(conn, XCB_COPY_FROM_PARENT, window, root_of(conn), x, y, 30,
+                    40, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
+                    0, NULL);
+  return window;
+}
+
+static uint32_t event_mask_of(xcb_connection_t *conn, xcb_window_t window) {
+  xcb_get_window_attributes_reply_t *attrs = xcb_get_window_attributes_reply(
+      conn, xcb_get_window_attributes(conn, window), NULL);
+  assert(attrs);
+  uint32_t mask = attrs->your_event_mask;
+  free(attrs);
+  return mask;
+}
+
+// Sets _NET_ACTIVE_WINDOW and feeds events to the tracker until it follows
+static void activate(X11FocusContext *ctx, xcb_window_t window) {
+  xcb_ewmh_set_active_window(ctx->ewmh, 0, window);
+  xcb_flush(ctx->conn);
+  while (ctx->active.window != window) {
+    xcb_generic_event_t *event = xcb_wait_for_event(ctx->conn);
+    assert(event);
+    x11_focus_handle_event(ctx, event);
+    free(event);
+  }
+}
+
+static void test_active_window_masks() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(!xcb_connection_has_error(conn));
+  xcb_ewmh_connection_t ewmh;
+  assert(xcb_ewmh_init_atoms_replies(&ewmh, xcb_ewmh_init_atoms(conn, &ewmh),
+                                     NULL));
+  X11FocusContext *ctx = x11_focus_init(conn, root_of(conn), &ewmh);
+  xcb_window_t a = create_window(conn, 10, 20);
+  xcb_window_t b = create_window(conn, 50, 60);
+  xcb_ewmh_set_active_window(&ewmh, 0, a);
+  assert(x11_focus_track_active(ctx));
+  assert(ctx->active.window == a);
+  assert(event_mask_of(conn, a) == X11_ACTIVE_EVENT_MASK);
+
+  int x, y, width, height;
+  assert(x11_focus_active_geometry(ctx, &x, &y, &width, &height));
+  assert(x == 10 && y == 20 && width == 30 && height == 40);
+
+  // Nothing else watches the previous window: deselected entirely
+  activate(ctx, b);
+  assert(event_mask_of(conn, a) == 0);
+  assert(event_mask_of(conn, b) == X11_ACTIVE_EVENT_MASK);
+  assert(x11_focus_active_geometry(ctx, &x, &y, NULL, NULL));
+  assert(x == 50 && y == 60);
+
+  // With a live window list the list's mask stays selected
+  ctx->active.client_mask = X11_CLIENT_EVENT_MASK;
+  activate(ctx, a);
+  assert(event_mask_of(conn, b) == X11_CLIENT_EVENT_MASK);
+  assert(event_mask_of(conn, a) ==
+         (X11_CLIENT_EVENT_MASK | X11_ACTIVE_EVENT_MASK));
+
+  // No active window: callers fall back to the input focus
+  activate(ctx, XCB_NONE);
+  assert(!x11_focus_active_geometry(ctx, &x, &y, NULL, NULL));
+
+  xcb_destroy_window(conn, a);
+  xcb_destroy_window(conn, b);
+  x11_focus_cleanup(ctx);
+  xcb_ewmh_connection_wipe(&ewmh);
+  xcb_disconnect(conn);
+}
+
+static xcb_generic_event_t *fake_event(uint8_t type) {
+  xcb_generic_event_t *event = calloc(1, sizeof(xcb_generic_event_t));
+  event->response_type = type;
+  return event;
+}
+
+static void test_deferred_events() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(!xcb_connection_has_error(conn));
+  X11FocusContext *ctx = x11_focus_init(conn, root_of(conn), NULL);
+  assert(!x11_focus_has_deferred_events(ctx));
+
+  // Handed back first, in the order they were read
+  x11_focus_defer_event(ctx, fake_event(XCB_KEY_PRESS));
+  x11_focus_defer_event(ctx, fake_event(XCB_KEY_RELEASE));
+  assert(x11_focus_has_deferred_events(ctx));
+  xcb_generic_event_t *event = x11_focus_poll_event(ctx);
+  assert(event && event->response_type == XCB_KEY_PRESS);
+  free(event);
+  event = x11_focus_poll_event(ctx);
+  assert(event && event->response_type == XCB_KEY_RELEASE);
+  free(event);
+  assert(!x11_focus_has_deferred_events(ctx));
+
+  // A full queue drops (and frees) what does not fit
+  for (int i = 0; i < X11_DEFERRED_EVENTS + 1; i++)
+    x11_focus_defer_event(ctx, fake_event(XCB_KEY_PRESS));
+  assert(ctx->deferred_count == X11_DEFERRED_EVENTS);
+
+  // Cleanup frees the rest
+  x11_focus_cleanup(ctx);
+  xcb_disconnect(conn);
+}
+
+static void test_grab_stats_format() {
+  X11GrabStats stats = {0};
+  char buffer[512];
+  assert(x11_grab_stats_format(NULL, buffer, sizeof(buffer)) == 0);
+  assert(x11_grab_stats_format(&stats, buffer, 0) == 0);
+
+  stats.attempts = 4;
+  x11_grab_stats_record(&stats, true, 500);
+  x11_grab_stats_record(&stats, true, 3500);
+  x11_grab_stats_record(&stats, false, 1000000);
+  assert(x11_grab_stats_format(&stats, buffer, sizeof(buffer)) > 0);
+  assert(strstr(buffer, "Grabs: 2 ok, 1 failed, 4 attempts"));
+  assert(strstr(buffer, "last 3500us min 500us avg 2000us max 3500us"));
+  assert(strstr(buffer, "<1ms:1 <5ms:1 <20ms:0"));
+  assert(strstr(buffer, ">=500ms:0"));
+
+  // Truncated like snprintf, still terminated
+  char small[8];
+  assert(x11_grab_stats_format(&stats, small, sizeof(small)) >= 8);
+  assert(strlen(small) == sizeof(small) - 1);
+}
+
+int main() {
+  test_grab_stats_format();
+  test_deferred_events();
+  test_active_window_masks();
+  test_grab_waits_for_release();
+  test_grab_gives_up_at_deadline();
+  printf("All x11_focus tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include "../src/cairo_menu_render.h"
+#include "../src/input_handler.h"
+#include "../src/menu_builder.h"
+#include "../src/x11_stats.h"
+#include "../src/x11_window.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+static int fake_reply_storage;
+
+static void *fake_reply(void) { return &fake_reply_storage; }
+
+static void test_counting() {
+  x11_op_stats_reset();
+
+  // Outside any operation nothing is attributed
+  assert(X11_SYNC(fake_reply()) == &fake_reply_storage);
+  for (int i = 0; i < X11_OP_COUNT; i++)
+    assert(x11_op_stats((X11Op)i)->replies == 0);
+
+  x11_op_enter(X11_OP_SHOW);
+  assert(X11_SYNC_OK(1) == 1);
+  assert(X11_SYNC_OK(0) == 0);
+  x11_op_leave();
+
+  const X11OpStats *show = x11_op_stats(X11_OP_SHOW);
+  assert(show->calls == 1);
+  assert(show->round_trips == 2);
+  assert(show->replies == 2);
+}
+
+static void test_batch_counts_once() {
+  x11_op_stats_reset();
+
+  x11_op_enter(X11_OP_REFRESH);
+  x11_rt_batch_begin();
+  for (int i = 0; i < 10; i++)
+    X11_SYNC(fake_reply());
+  x11_rt_batch_begin(); // nested batches share the outer round-trip
+  X11_SYNC(fake_reply());
+  x11_rt_batch_end();
+  x11_rt_batch_end();
+  X11_SYNC(fake_reply());
+  x11_op_leave();
+
+  const X11OpStats *refresh = x11_op_stats(X11_OP_REFRESH);
+  assert(refresh->round_trips == 2);
+  assert(refresh->replies == 12);
+}
+
+static void test_nested_ops_are_inclusive() {
+  x11_op_stats_reset();
+
+  x11_op_enter(X11_OP_ACTIVATE);
+  X11_SYNC(fake_reply());
+  x11_op_enter(X11_OP_SHOW);
+  x11_op_enter(X11_OP_SELECT);
+  x11_op_enter(X11_OP_SELECT); // re-entered: still counted once
+  X11_SYNC(fake_reply());
+  x11_op_leave();
+  x11_op_leave();
+  x11_op_leave();
+  x11_op_leave();
+
+  assert(x11_op_stats(X11_OP_ACTIVATE)->round_trips == 2);
+  assert(x11_op_stats(X11_OP_SHOW)->round_trips == 1);
+  assert(x11_op_stats(X11_OP_SELECT)->round_trips == 1);
+  assert(x11_op_stats(X11_OP_SELECT)->calls == 2);
+  assert(x11_op_stats(X11_OP_SETUP)->round_trips == 0);
+
+  char buffer[512];
+  assert(x11_op_stats_format(buffer, sizeof(buffer)) > 0);
+  assert(strstr(buffer, "RT activate: 2 round-trips"));
+  assert(strstr(buffer, "RT setup: 0 round-trips"));
+  assert(x11_op_stats(X11_OP_COUNT) == NULL);
+}
+
+static void test_refresh_budget() {
+  xcb_connection_t *conn = xcb_connect(NULL, NULL);
+  assert(conn && !xcb_connection_has_error(conn));
+  xcb_ewmh_connection_t ewmh;
+  assert(xcb_ewmh_init_atoms_replies(&ewmh, xcb_ewmh_init_atoms(conn, &ewmh),
+                                     NULL));
+
+  // Client list and focus share one round-trip; properties are pipelined
+  WindowList *list = window_list_init(conn, &ewmh);
+  assert(list);
+  x11_op_stats_reset();
+  window_list_update(list, conn, &ewmh);
+  const X11OpStats *refresh = x11_op_stats(X11_OP_REFRESH);
+  assert(refresh->calls == 1);
+  assert(refresh->round_trips <= 4);
+
+  window_list_free(list);
+  xcb_ewmh_connection_wipe(&ewmh);
+  xcb_disconnect(conn);
+}
+
+// Waits until the server has processed everything sent so far and hands the
+// resulting events (upload completions among them) to the handler
+static void settle(InputHandler *handler) {
+  free(xcb_get_input_focus_reply(
+      handler->conn, xcb_get_input_focus(handler->conn), NULL));
+  xcb_generic_event_t *event;
+  while ((event = xcb_poll_for_event(handler->conn))) {
+    input_handler_handle_event(handler, event);
+    free(event);
+  }
+}
+
+static void test_daemon_show_budget() {
+  InputHandler *handler = input_handler_create();
+  handler->daemon_mode = true;
+  assert(input_handler_setup_x(handler) && "Input handler X setup failed");
+  assert(x11_op_stats(X11_OP_SETUP)->calls >= 1);
+  assert(handler->menu_pool && handler->menu_pool->count > 0);
+
+  MenuBuilder builder = menu_builder_create("Budget Menu", 3);
+  menu_builder_add_item(&builder, "Item 1", NULL, 0);
+  menu_builder_add_item(&builder, "Item 2", NULL, 0);
+  menu_builder_add_item(&builder, "Item 3", NULL, 0);
+  menu_builder_set_mod_key(&builder, XCB_MOD_MASK_4);
+  menu_builder_set_trigger_key(&builder, 31);
+  menu_builder_set_activation_state(&builder, XCB_MOD_MASK_4, 31);
+  MenuConfig *config = menu_builder_finalize(&builder);
+  Menu *menu = menu_create(config);
+  assert(menu);
+  input_handler_add_menu(handler, menu);
+
+  xcb_key_press_event_t trigger = {
+      .response_type = XCB_KEY_PRESS, .detail = 31, .state = XCB_MOD_MASK_4};
+
+  // First open binds a window from the pool; later shows of the resident
+  // menu must not wait on the server at all.
+  input_handler_handle_event(handler, (xcb_generic_event_t *)&trigger);
+  assert(menu->active);
+  assert(menu->user_data == handler->menu_pool->slots[0]);
+  xcb_pixmap_t pixmap =
+      ((CairoMenuData *)menu->user_data)->render.frame_pixmap;
+  menu_manager_deactivate(handler->menu_manager);
+  // Let the first frame's upload complete before counting
+  settle(handler);
+
+  x11_op_stats_reset();
+  input_handler_handle_event(handler, (xcb_generic_event_t *)&trigger);
+  assert(menu->active);
+  assert(x11_op_stats(X11_OP_ACTIVATE)->calls == 1);
+  assert(x11_op_stats(X11_OP_SHOW)->calls == 1);
+  assert(x11_op_stats(X11_OP_SHOW)->round_trips == 0);
+
+  // The frame was uploaded to the window background before the map
+  CairoMenuData *data = menu->user_data;
+  assert(data->render.upload == CAIRO_MENU_UPLOAD_DIRECT ||
+         data->render.frame_pixmap != XCB_NONE);
+  // Sized for the reservation: showing the menu kept the pooled storage
+  assert(data->render.frame_pixmap == pixmap);
+  assert(data->render.upload == CAIRO_MENU_UPLOAD_DIRECT ||
+         (data->render.buffer_width >= data->render.width &&
+          data->render.buffer_height >= data->render.height));
+
+  // Moving the selection repaints in place, once the upload of the shown
+  // frame has completed
+  settle(handler);
+  assert(!data->render.shm_fence_pending);
+  int width = data->render.width, height = data->render.height;
+  menu_select_next(menu);
+  assert(menu->selected_index == 1);
+  assert(x11_op_stats(X11_OP_SELECT)->round_trips == 0);
+  assert(data->render.width == width && data->render.height == height);
+
+  char *status = menu_manager_status_string(handler->menu_manager);
+  assert(status && strstr(status, "RT show: 0 round-trips"));
+  free(status);
+
+  // Registering another menu measures it off-screen: the layout the target
+  // caches for the menu it shows is left alone
+  assert(data->layout.valid && data->layout.title == menu->config.title);
+  MenuBuilder wide =
+      menu_builder_create("A menu with a title much wider than the first", 1);
+  menu_builder_add_item(&wide, "Item", NULL, 0);
+  menu_builder_set_mod_key(&wide, XCB_MOD_MASK_4);
+  menu_builder_set_trigger_key(&wide, 32);
+  menu_builder_set_activation_state(&wide, XCB_MOD_MASK_4, 32);
+  Menu *other = menu_create(menu_builder_finalize(&wide));
+  assert(other);
+  input_handler_add_menu(handler, other);
+  assert(handler->menu_pool->reserve_width > width);
+  assert(data->layout.valid && data->layout.title == menu->config.title);
+
+  input_handler_destroy(handler);
+}
+
+int main() {
+  test_counting();
+  test_batch_counts_once();
+  test_nested_ops_are_inclusive();
+  test_refresh_budget();
+  test_daemon_show_budget();
+  printf("All x11_stats tests passed.\n");
+  return 0;
+}